@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+
+#include "affinity.h"
+#include <mpi.h>
+#include <omp.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BINDING_LINE_LENGTH 256
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+// Anonymous mappings are not backed by physical pages until they are first
+// written, so each page lands on the NUMA node of the thread that touches it
+// first. The training shard is filled by the same per-thread blocks the SGD
+// loop reads; the feature matrices are only spread across nodes, since
+// Hogwild updates reach their rows at random. Large mappings are also marked
+// for transparent huge pages to cut TLB misses in the SGD loop.
+void *alloc_first_touch(size_t bytes) {
+  if (bytes == 0)
+    return NULL;
+  void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    fprintf(stderr, "Error: failed to map %zu bytes\n", bytes);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+#ifdef MADV_HUGEPAGE
+  if (bytes >= HUGE_PAGE_SIZE)
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+  return ptr;
+}
+
+void free_first_touch(void *ptr, size_t bytes) {
+  if (ptr)
+    munmap(ptr, bytes);
+}
+
+static int cpu_socket(int cpu) {
+  char path[128];
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+  FILE *f = fopen(path, "r");
+  int socket = -1;
+  if (f) {
+    if (fscanf(f, "%d", &socket) != 1)
+      socket = -1;
+    fclose(f);
+  }
+  return socket;
+}
+
+static void format_cpu_set(const cpu_set_t *set, char *buf, size_t len) {
+  size_t used = 0;
+  buf[0] = '\0';
+  for (int cpu = 0; cpu < CPU_SETSIZE && used < len; cpu++) {
+    if (!CPU_ISSET(cpu, set))
+      continue;
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+      last++;
+    if (last == cpu)
+      used += snprintf(buf + used, len - used, "%s%d", used ? "," : "", cpu);
+    else
+      used += snprintf(buf + used, len - used, "%s%d-%d", used ? "," : "",
+                       cpu, last);
+    cpu = last;
+  }
+}
+
+void report_binding(int rank, int size) {
+  char host[MPI_MAX_PROCESSOR_NAME];
+  int host_len;
+  MPI_Get_processor_name(host, &host_len);
+
+  int num_threads = omp_get_max_threads();
+  char *local =
+      (char *)calloc((size_t)num_threads * BINDING_LINE_LENGTH, sizeof(char));
+
+#pragma omp parallel num_threads(num_threads)
+  {
+    int tid = omp_get_thread_num();
+    int cpu = sched_getcpu();
+    cpu_set_t allowed;
+    char allowed_str[128] = "?";
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+      format_cpu_set(&allowed, allowed_str, sizeof(allowed_str));
+    snprintf(local + (size_t)tid * BINDING_LINE_LENGTH, BINDING_LINE_LENGTH,
+             "  rank %d on %s thread %d: cpu %d, socket %d, allowed cpus %s\n",
+             rank, host, tid, cpu, cpu_socket(cpu), allowed_str);
+  }
+
+  char *packed = (char *)malloc((size_t)num_threads * BINDING_LINE_LENGTH);
+  int packed_len = 0;
+  for (int t = 0; t < num_threads; t++) {
+    int len = strlen(local + (size_t)t * BINDING_LINE_LENGTH);
+    memcpy(packed + packed_len, local + (size_t)t * BINDING_LINE_LENGTH, len);
+    packed_len += len;
+  }
+
+  int *lengths = NULL, *offsets = NULL;
+  char *all = NULL;
+  if (rank == 0) {
+    lengths = (int *)malloc(size * sizeof(int));
+    offsets = (int *)malloc(size * sizeof(int));
+  }
+  MPI_Gather(&packed_len, 1, MPI_INT, lengths, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    int total = 0;
+    for (int r = 0; r < size; r++) {
+      offsets[r] = total;
+      total += lengths[r];
+    }
+    all = (char *)malloc(total + 1);
+    all[total] = '\0';
+  }
+  MPI_Gatherv(packed, packed_len, MPI_CHAR, all, lengths, offsets, MPI_CHAR, 0,
+              MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    printf("Process binding (%d processes x %d threads):\n%s", size,
+           num_threads, all);
+    free(all);
+    free(lengths);
+    free(offsets);
+  }
+
+  free(packed);
+  free(local);
+}
@@ -0,0 +1,10 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+
+void *alloc_first_touch(size_t bytes);
+void free_first_touch(void *ptr, size_t bytes);
+void report_binding(int rank, int size);
+
+#endif
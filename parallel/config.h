@@ -7,5 +7,6 @@
 #define REGULARIZATION 0.01
 #define NUM_ITERATIONS 50
 #define TRAIN_TEST_SPLIT 0.8
+#define RANDOM_SEED 42ULL
 
 #endif
\ No newline at end of file
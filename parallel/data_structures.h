@@ -20,6 +20,8 @@ typedef struct {
 typedef struct {
   float **user_features;
   float **movie_features;
+  float *user_feature_data;
+  float *movie_feature_data;
   float *user_bias;
   float *movie_bias;
   float global_mean;
@@ -1,3 +1,4 @@
+#include "affinity.h"
 #include "config.h"
 #include "data_loader.h"
 #include "data_structures.h"
@@ -11,9 +12,17 @@ int main(int argc, char **argv) {
   int rank, size;
   double start_time, end_time;
 
-  MPI_Init(&argc, &argv);
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (provided < MPI_THREAD_FUNNELED) {
+    if (rank == 0) {
+      fprintf(stderr, "Error: MPI library does not support "
+                      "MPI_THREAD_FUNNELED\n");
+    }
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
   if (argc < 2) {
     if (rank == 0) {
@@ -25,6 +34,8 @@ int main(int argc, char **argv) {
 
   start_time = MPI_Wtime();
 
+  report_binding(rank, size);
+
   if (rank == 0) {
     printf("Loading dataset\n");
   }
@@ -61,7 +72,7 @@ int main(int argc, char **argv) {
     printf("Global mean rating: %.4f\n", model->global_mean);
   }
 
-  initialize_model(model, rank);
+  initialize_model(model, RANDOM_SEED);
 
   if (rank == 0) {
     printf("Training model with %d factors for %d iterations\n", NUM_FACTORS,
@@ -73,10 +84,11 @@ int main(int argc, char **argv) {
   if (rank == 0) {
     printf("Computing RMSE on test set\n");
   }
-  float rmse = compute_rmse(model, test_data, rank, size);
+  float mae;
+  float rmse = compute_rmse(model, test_data, rank, size, &mae);
 
   if (rank == 0) {
-    printf("Test RMSE: %.4f\n", rmse);
+    printf("Test RMSE: %.4f, MAE: %.4f\n", rmse, mae);
   }
 
   end_time = MPI_Wtime();
@@ -1,7 +1,8 @@
 #include "model.h"
+#include "affinity.h"
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <time.h>
 
 Model *create_model(int num_users, int num_movies, int num_factors,
                     float learning_rate, float regularization) {
@@ -13,14 +14,21 @@ Model *create_model(int num_users, int num_movies, int num_factors,
   model->regularization = regularization;
   model->global_mean = 0.0f;
 
+  model->user_feature_data = (float *)alloc_first_touch(
+      (size_t)num_users * num_factors * sizeof(float));
+  model->movie_feature_data = (float *)alloc_first_touch(
+      (size_t)num_movies * num_factors * sizeof(float));
+
   model->user_features = (float **)malloc(num_users * sizeof(float *));
   for (int i = 0; i < num_users; i++) {
-    model->user_features[i] = (float *)malloc(num_factors * sizeof(float));
+    model->user_features[i] =
+        model->user_feature_data + (size_t)i * num_factors;
   }
 
   model->movie_features = (float **)malloc(num_movies * sizeof(float *));
   for (int i = 0; i < num_movies; i++) {
-    model->movie_features[i] = (float *)malloc(num_factors * sizeof(float));
+    model->movie_features[i] =
+        model->movie_feature_data + (size_t)i * num_factors;
   }
 
   model->user_bias = (float *)calloc(num_users, sizeof(float));
@@ -31,14 +39,10 @@ Model *create_model(int num_users, int num_movies, int num_factors,
 
 void free_model(Model *model) {
   if (model) {
-    for (int i = 0; i < model->num_users; i++) {
-      free(model->user_features[i]);
-    }
+    size_t row_bytes = model->num_factors * sizeof(float);
+    free_first_touch(model->user_feature_data, model->num_users * row_bytes);
+    free_first_touch(model->movie_feature_data, model->num_movies * row_bytes);
     free(model->user_features);
-
-    for (int i = 0; i < model->num_movies; i++) {
-      free(model->movie_features[i]);
-    }
     free(model->movie_features);
 
     free(model->user_bias);
@@ -48,18 +52,39 @@ void free_model(Model *model) {
   }
 }
 
-void initialize_model(Model *model, int rank) {
-  unsigned int seed = time(NULL) + rank;
+// splitmix64 finalizer used as a counter-based generator: every parameter is
+// a pure function of (seed, matrix, row, factor), so the initial model does
+// not depend on the number of ranks or threads, or on the order of the fill.
+static inline uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static inline float init_value(uint64_t key, uint64_t counter) {
+  uint64_t bits = splitmix64(key + counter);
+  return (float)(bits >> 40) * (1.0f / 16777216.0f) * 0.1f;
+}
+
+void initialize_model(Model *model, unsigned long long seed) {
+  uint64_t user_key = splitmix64(seed);
+  uint64_t movie_key = splitmix64(user_key);
+  int num_factors = model->num_factors;
 
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < model->num_users; i++) {
-    for (int j = 0; j < model->num_factors; j++) {
-      model->user_features[i][j] = ((float)rand_r(&seed) / RAND_MAX) * 0.1;
+    for (int j = 0; j < num_factors; j++) {
+      model->user_features[i][j] =
+          init_value(user_key, (uint64_t)i * num_factors + j);
     }
   }
 
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < model->num_movies; i++) {
-    for (int j = 0; j < model->num_factors; j++) {
-      model->movie_features[i][j] = ((float)rand_r(&seed) / RAND_MAX) * 0.1;
+    for (int j = 0; j < num_factors; j++) {
+      model->movie_features[i][j] =
+          init_value(movie_key, (uint64_t)i * num_factors + j);
     }
   }
 }
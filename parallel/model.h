@@ -6,7 +6,7 @@
 Model *create_model(int num_users, int num_movies, int num_factors,
                     float learning_rate, float regularization);
 void free_model(Model *model);
-void initialize_model(Model *model, int rank);
+void initialize_model(Model *model, unsigned long long seed);
 void compute_global_mean(Model *model, Dataset *dataset);
 
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "train.h"
+#include "affinity.h"
 #include "config.h"
 #include <math.h>
 #include <mpi.h>
@@ -24,6 +25,60 @@ static float predict_rating(Model *model, int user_id, int movie_id) {
   return prediction;
 }
 
+// Each rank's vote for a row is the number of SGD updates it applied to that
+// row since the last sync. The local shard is fixed across epochs, so that is
+// the row's occurrence count in the shard times the epochs since the sync, and
+// the epoch factor cancels out of the weighted mean. Rows nobody trains fall
+// back to a plain mean so all ranks still agree on them.
+static void compute_sync_weights(const Dataset *train_data, int local_start,
+                                 int local_end, int num_rows, int use_user,
+                                 int size, float *weight, float *inv_total) {
+  int *counts = (int *)calloc(num_rows, sizeof(int));
+  for (int idx = local_start; idx < local_end; idx++) {
+    int row = use_user ? train_data->ratings[idx].user_id
+                       : train_data->ratings[idx].movie_id;
+    counts[row]++;
+  }
+
+  int *totals = (int *)malloc(num_rows * sizeof(int));
+  MPI_Allreduce(counts, totals, num_rows, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+  for (int i = 0; i < num_rows; i++) {
+    if (totals[i] > 0) {
+      weight[i] = (float)counts[i];
+      inv_total[i] = 1.0f / totals[i];
+    } else {
+      weight[i] = 1.0f;
+      inv_total[i] = 1.0f / size;
+    }
+  }
+
+  free(counts);
+  free(totals);
+}
+
+// Contiguous block of [0, count) owned by the calling thread of the current
+// team. The shard copy and the SGD loop both use it, so each thread reads the
+// ratings it placed.
+static void thread_block(int count, int *begin, int *end) {
+  int thread = omp_get_thread_num();
+  int threads = omp_get_num_threads();
+  *begin = (int)((long long)count * thread / threads);
+  *end = (int)((long long)count * (thread + 1) / threads);
+}
+
+static void scale_rows(float *features, float *bias, const float *scale,
+                       int num_rows, int num_factors) {
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < num_rows; i++) {
+    float *row = features + (size_t)i * num_factors;
+    bias[i] *= scale[i];
+    for (int k = 0; k < num_factors; k++) {
+      row[k] *= scale[i];
+    }
+  }
+}
+
 void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
                           int rank, int size) {
   int local_start = (train_data->num_ratings / size) * rank;
@@ -41,12 +96,30 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
     printf("Using synchronization interval: %d iterations\n", sync_interval);
   }
 
-  int user_feature_size = model->num_users * model->num_factors;
-  int movie_feature_size = model->num_movies * model->num_factors;
-  float *flat_user_features =
-      (float *)malloc(user_feature_size * sizeof(float));
-  float *flat_movie_features =
-      (float *)malloc(movie_feature_size * sizeof(float));
+  float *user_weight = (float *)malloc(model->num_users * sizeof(float));
+  float *user_inv_total = (float *)malloc(model->num_users * sizeof(float));
+  float *movie_weight = (float *)malloc(model->num_movies * sizeof(float));
+  float *movie_inv_total = (float *)malloc(model->num_movies * sizeof(float));
+  compute_sync_weights(train_data, local_start, local_end, model->num_users, 1,
+                       size, user_weight, user_inv_total);
+  compute_sync_weights(train_data, local_start, local_end, model->num_movies,
+                       0, size, movie_weight, movie_inv_total);
+
+  // The broadcast left every rating on the master thread's NUMA node. Each
+  // thread copies exactly the block of the shard it later trains on, with the
+  // same team size, so its pages are first touched from its own node.
+  int local_count = local_end - local_start;
+  int num_threads = omp_get_max_threads();
+  Rating *shard =
+      (Rating *)alloc_first_touch((size_t)local_count * sizeof(Rating));
+#pragma omp parallel num_threads(num_threads)
+  {
+    int begin, end;
+    thread_block(local_count, &begin, &end);
+    for (int i = begin; i < end; i++) {
+      shard[i] = train_data->ratings[local_start + i];
+    }
+  }
 
   double comm_time = 0.0, comp_time = 0.0;
   int sync_count = 0;
@@ -54,32 +127,40 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
   for (int iter = 0; iter < num_iterations; iter++) {
     double iter_start = MPI_Wtime();
 
-    for (int idx = local_start; idx < local_end; idx++) {
-      int user_id = train_data->ratings[idx].user_id;
-      int movie_id = train_data->ratings[idx].movie_id;
-      float actual_rating = train_data->ratings[idx].rating;
-
-      float predicted_rating = predict_rating(model, user_id, movie_id);
-      float error = actual_rating - predicted_rating;
-
-      model->user_bias[user_id] +=
-          model->learning_rate *
-          (error - model->regularization * model->user_bias[user_id]);
-      model->movie_bias[movie_id] +=
-          model->learning_rate *
-          (error - model->regularization * model->movie_bias[movie_id]);
-
-      for (int k = 0; k < model->num_factors; k++) {
-        float user_feature = model->user_features[user_id][k];
-        float movie_feature = model->movie_features[movie_id][k];
-
-        float user_grad =
-            error * movie_feature - model->regularization * user_feature;
-        float movie_grad =
-            error * user_feature - model->regularization * movie_feature;
-
-        model->user_features[user_id][k] += model->learning_rate * user_grad;
-        model->movie_features[movie_id][k] += model->learning_rate * movie_grad;
+    // Threads update shared rows without locks (Hogwild-style); ratings are
+    // sparse enough that conflicting updates are rare and SGD absorbs them.
+#pragma omp parallel num_threads(num_threads)
+    {
+      int begin, end;
+      thread_block(local_count, &begin, &end);
+      for (int idx = begin; idx < end; idx++) {
+        int user_id = shard[idx].user_id;
+        int movie_id = shard[idx].movie_id;
+        float actual_rating = shard[idx].rating;
+
+        float predicted_rating = predict_rating(model, user_id, movie_id);
+        float error = actual_rating - predicted_rating;
+
+        model->user_bias[user_id] +=
+            model->learning_rate *
+            (error - model->regularization * model->user_bias[user_id]);
+        model->movie_bias[movie_id] +=
+            model->learning_rate *
+            (error - model->regularization * model->movie_bias[movie_id]);
+
+        for (int k = 0; k < model->num_factors; k++) {
+          float user_feature = model->user_features[user_id][k];
+          float movie_feature = model->movie_features[movie_id][k];
+
+          float user_grad =
+              error * movie_feature - model->regularization * user_feature;
+          float movie_grad =
+              error * user_feature - model->regularization * movie_feature;
+
+          model->user_features[user_id][k] += model->learning_rate * user_grad;
+          model->movie_features[movie_id][k] +=
+              model->learning_rate * movie_grad;
+        }
       }
     }
 
@@ -89,54 +170,27 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
       double comm_start = MPI_Wtime();
       sync_count++;
 
-      for (int i = 0; i < model->num_users; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          flat_user_features[base_idx + k] = model->user_features[i][k];
-        }
-      }
-
-      for (int i = 0; i < model->num_movies; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          flat_movie_features[base_idx + k] = model->movie_features[i][k];
-        }
-      }
+      scale_rows(model->user_feature_data, model->user_bias, user_weight,
+                 model->num_users, model->num_factors);
+      scale_rows(model->movie_feature_data, model->movie_bias, movie_weight,
+                 model->num_movies, model->num_factors);
 
       MPI_Allreduce(MPI_IN_PLACE, model->user_bias, model->num_users, MPI_FLOAT,
                     MPI_SUM, MPI_COMM_WORLD);
       MPI_Allreduce(MPI_IN_PLACE, model->movie_bias, model->num_movies,
                     MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
 
-      MPI_Allreduce(MPI_IN_PLACE, flat_user_features, user_feature_size,
-                    MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-
-      MPI_Allreduce(MPI_IN_PLACE, flat_movie_features, movie_feature_size,
-                    MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-
-      float scale = 1.0f / size;
-
-      for (int i = 0; i < model->num_users; i++) {
-        model->user_bias[i] *= scale;
-      }
-      for (int i = 0; i < model->num_movies; i++) {
-        model->movie_bias[i] *= scale;
-      }
+      MPI_Allreduce(MPI_IN_PLACE, model->user_feature_data,
+                    model->num_users * model->num_factors, MPI_FLOAT, MPI_SUM,
+                    MPI_COMM_WORLD);
+      MPI_Allreduce(MPI_IN_PLACE, model->movie_feature_data,
+                    model->num_movies * model->num_factors, MPI_FLOAT, MPI_SUM,
+                    MPI_COMM_WORLD);
 
-      for (int i = 0; i < model->num_users; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          model->user_features[i][k] = flat_user_features[base_idx + k] * scale;
-        }
-      }
-
-      for (int i = 0; i < model->num_movies; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          model->movie_features[i][k] =
-              flat_movie_features[base_idx + k] * scale;
-        }
-      }
+      scale_rows(model->user_feature_data, model->user_bias, user_inv_total,
+                 model->num_users, model->num_factors);
+      scale_rows(model->movie_feature_data, model->movie_bias, movie_inv_total,
+                 model->num_movies, model->num_factors);
 
       comm_time += MPI_Wtime() - comm_start;
 
@@ -159,38 +213,68 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
            (1.0 - (float)sync_count / num_iterations) * 100);
   }
 
-  free(flat_user_features);
-  free(flat_movie_features);
+  free_first_touch(shard, (size_t)local_count * sizeof(Rating));
+  free(user_weight);
+  free(user_inv_total);
+  free(movie_weight);
+  free(movie_inv_total);
 }
 
-float compute_rmse(Model *model, Dataset *test_data, int rank, int size) {
-  int local_start = (test_data->num_ratings / size) * rank;
-  int local_end = (rank == size - 1)
-                      ? test_data->num_ratings
-                      : (test_data->num_ratings / size) * (rank + 1);
-
-  float local_squared_error = 0.0;
-
-  for (int idx = local_start; idx < local_end; idx++) {
-    int user_id = test_data->ratings[idx].user_id;
-    int movie_id = test_data->ratings[idx].movie_id;
-    float actual_rating = test_data->ratings[idx].rating;
-
-    float predicted_rating = predict_rating(model, user_id, movie_id);
-    float error = actual_rating - predicted_rating;
-    local_squared_error += error * error;
-  }
-
-  float total_squared_error = 0.0;
-  MPI_Reduce(&local_squared_error, &total_squared_error, 1, MPI_FLOAT, MPI_SUM,
-             0, MPI_COMM_WORLD);
-
-  float rmse = 0.0;
-  if (rank == 0) {
-    rmse = sqrt(total_squared_error / test_data->num_ratings);
+// Each rank takes a contiguous range of the test set and its threads predict
+// from the flat factor rows with a SIMD dot product. Squared and absolute
+// errors are summed in compensated (Kahan) doubles in the same pass, so the
+// results do not drift on large test sets, and one Allreduce gives every rank
+// both totals. The MAE is stored in *mae.
+float compute_rmse(Model *model, Dataset *test_data, int rank, int size,
+                   float *mae) {
+  int local_start = (int)((long long)test_data->num_ratings * rank / size);
+  int local_end = (int)((long long)test_data->num_ratings * (rank + 1) / size);
+  int k = model->num_factors;
+
+  // Squared error, absolute error.
+  double totals[2] = {0.0, 0.0};
+#pragma omp parallel
+  {
+    double sum = 0.0, carry = 0.0;
+    double abs_sum = 0.0, abs_carry = 0.0;
+#pragma omp for schedule(static)
+    for (int idx = local_start; idx < local_end; idx++) {
+      const Rating *rating = &test_data->ratings[idx];
+      const float *p = model->user_feature_data + (size_t)rating->user_id * k;
+      const float *q =
+          model->movie_feature_data + (size_t)rating->movie_id * k;
+      float dot = 0.0f;
+#pragma omp simd reduction(+ : dot)
+      for (int f = 0; f < k; f++)
+        dot += p[f] * q[f];
+      float prediction = model->global_mean +
+                         model->user_bias[rating->user_id] +
+                         model->movie_bias[rating->movie_id] + dot;
+      if (prediction > 5.0f)
+        prediction = 5.0f;
+      if (prediction < 0.5f)
+        prediction = 0.5f;
+
+      double error = (double)rating->rating - prediction;
+      double y = error * error - carry;
+      double t = sum + y;
+      carry = (t - sum) - y;
+      sum = t;
+
+      y = fabs(error) - abs_carry;
+      t = abs_sum + y;
+      abs_carry = (t - abs_sum) - y;
+      abs_sum = t;
+    }
+#pragma omp critical
+    {
+      totals[0] += sum - carry;
+      totals[1] += abs_sum - abs_carry;
+    }
   }
 
-  MPI_Bcast(&rmse, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
-
-  return rmse;
-}
\ No newline at end of file
+  MPI_Allreduce(MPI_IN_PLACE, totals, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  int n = test_data->num_ratings;
+  *mae = n > 0 ? (float)(totals[1] / n) : 0.0f;
+  return n > 0 ? (float)sqrt(totals[0] / n) : 0.0f;
+}
@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+// Each block is one anonymous mapping with its header at the front. Blocks of
+// at least a huge page are rounded up to a huge page multiple and first tried
+// with explicit huge pages, then fall back to normal pages with a transparent
+// huge page hint. Mappings start zero-filled and are untouched until first
+// written, so callers get calloc semantics and first-touch placement. A
+// failed mapping makes the allocation return NULL; the caller reports it.
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+  size_t used;
+};
+
+static size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static ArenaBlock *map_block(Arena *arena, size_t size) {
+  void *ptr = MAP_FAILED;
+  int huge = size >= HUGE_PAGE_SIZE;
+  if (huge) {
+    size = align_up(size, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  }
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+    if (ptr == MAP_FAILED)
+      return NULL;
+#ifdef MADV_HUGEPAGE
+    if (huge)
+      madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  ArenaBlock *block = (ArenaBlock *)ptr;
+  block->size = size;
+  block->used = align_up(sizeof(ArenaBlock), ARENA_ALIGNMENT);
+  arena->reserved += size;
+  arena->huge_blocks += huge;
+  return block;
+}
+
+Arena *arena_create(size_t block_size) {
+  Arena *arena = (Arena *)calloc(1, sizeof(Arena));
+  if (!arena)
+    return NULL;
+  arena->block_size = block_size;
+  return arena;
+}
+
+static void *arena_push(Arena *arena, size_t bytes, size_t alignment) {
+  ArenaBlock *block = arena->head;
+  size_t offset = block ? align_up(block->used, alignment) : 0;
+  if (!block || offset + bytes > block->size) {
+    size_t header = align_up(sizeof(ArenaBlock), ARENA_ALIGNMENT);
+    if (bytes + header > arena->block_size) {
+      // Oversized requests get a dedicated block behind the head, so the
+      // head's free space stays available for later small allocations.
+      block = map_block(arena, bytes + header);
+      if (!block)
+        return NULL;
+      block->used = block->size;
+      if (arena->head) {
+        block->next = arena->head->next;
+        arena->head->next = block;
+      } else {
+        block->next = NULL;
+        arena->head = block;
+      }
+      return (char *)block + header;
+    }
+    block = map_block(arena, arena->block_size);
+    if (!block)
+      return NULL;
+    block->next = arena->head;
+    arena->head = block;
+    offset = block->used;
+  }
+  block->used = offset + bytes;
+  return (char *)block + offset;
+}
+
+void *arena_alloc(Arena *arena, size_t bytes) {
+  return arena_push(arena, bytes, ARENA_ALIGNMENT);
+}
+
+char *arena_strdup(Arena *arena, const char *str) {
+  size_t len = strlen(str) + 1;
+  char *copy = (char *)arena_push(arena, len, 1);
+  if (copy)
+    memcpy(copy, str, len);
+  return copy;
+}
+
+void arena_destroy(Arena *arena) {
+  if (arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+      ArenaBlock *next = block->next;
+      munmap(block, block->size);
+      block = next;
+    }
+    free(arena);
+  }
+}
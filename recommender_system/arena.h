@@ -0,0 +1,20 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+  ArenaBlock *head;
+  size_t block_size;
+  size_t reserved;
+  int huge_blocks;
+} Arena;
+
+Arena *arena_create(size_t block_size);
+void *arena_alloc(Arena *arena, size_t bytes);
+char *arena_strdup(Arena *arena, const char *str);
+void arena_destroy(Arena *arena);
+
+#endif
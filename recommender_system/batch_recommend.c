@@ -0,0 +1,296 @@
+#include "config.h"
+#include "data_loader.h"
+#include "data_structures.h"
+#include "model.h"
+#include "model_io.h"
+#include "score.h"
+#include "topk.h"
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_MAGIC 0x4b504f54
+// Longest CSV line: three ints of up to 11 characters and a clamped score.
+#define CSV_LINE_MAX 48
+// MPI counts are ints, so CSV text goes out in slices of at most this size.
+#define CSV_WRITE_CHUNK (1 << 30)
+
+static int *read_user_list(const char *filename, IDMapper *mapper,
+                           Dataset *dataset, int rank, int *num_out) {
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+    fprintf(stderr, "Error opening user list: %s\n", filename);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  int capacity = 1024, count = 0, orig_id;
+  int *users = (int *)malloc(capacity * sizeof(int));
+  while (fscanf(f, "%d", &orig_id) == 1) {
+    if (orig_id < 0 || orig_id > dataset->max_user_id ||
+        mapper->reverse_user_map[mapper->user_map[orig_id]] != orig_id) {
+      if (rank == 0)
+        fprintf(stderr, "Skipping unknown user %d\n", orig_id);
+      continue;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      users = (int *)realloc(users, capacity * sizeof(int));
+    }
+    users[count++] = mapper->user_map[orig_id];
+  }
+  fclose(f);
+  *num_out = count;
+  return users;
+}
+
+// Binary output: int magic, int num_users, int k, then one fixed-size record
+// per user: original user id, k original movie ids (-1 padded) and k scores.
+// Fixed records let every rank write its user range at a computed offset.
+// Returns nonzero if any of this rank's file operations failed.
+static int write_binary(const char *filename, int num_users, int k,
+                        int local_start, int local_count, const int *records,
+                        int rank) {
+  MPI_File fh;
+  if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    return 1;
+
+  // Counting whole records keeps the write count an int for any output size.
+  MPI_Datatype record_type;
+  MPI_Type_contiguous(1 + 2 * k, MPI_INT, &record_type);
+  MPI_Type_commit(&record_type);
+
+  int header[3] = {BATCH_MAGIC, num_users, k};
+  MPI_Offset record_bytes = (MPI_Offset)(1 + 2 * k) * sizeof(int);
+  int failed =
+      MPI_File_set_size(fh, sizeof(header) + record_bytes * num_users) !=
+      MPI_SUCCESS;
+  failed |= !write_slice(fh, 0, header, rank == 0 ? 3 : 0, MPI_INT);
+  failed |= !write_slice(fh, sizeof(header) + record_bytes * local_start,
+                         records, local_count, record_type);
+  failed |= MPI_File_close(&fh) != MPI_SUCCESS;
+  MPI_Type_free(&record_type);
+  return failed;
+}
+
+// Returns nonzero if any of this rank's file operations failed.
+static int write_csv(const char *filename, const char *text, long long len,
+                     int rank) {
+  MPI_File fh;
+  if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    return 1;
+
+  long long offset = 0, total = 0;
+  MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0)
+    offset = 0;
+  MPI_Allreduce(&len, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  int failed = MPI_File_set_size(fh, total) != MPI_SUCCESS;
+
+  // The writes are collective, so every rank takes part in as many rounds as
+  // the rank with the most text, passing empty slices once it is done.
+  long long rounds = (len + CSV_WRITE_CHUNK - 1) / CSV_WRITE_CHUNK;
+  MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_LONG_LONG, MPI_MAX,
+                MPI_COMM_WORLD);
+  for (long long r = 0; r < rounds; r++) {
+    long long done = r * CSV_WRITE_CHUNK;
+    long long remaining = len > done ? len - done : 0;
+    int chunk = remaining < CSV_WRITE_CHUNK ? (int)remaining : CSV_WRITE_CHUNK;
+    failed |= !write_slice(fh, offset + done, text + (chunk ? done : 0), chunk,
+                           MPI_CHAR);
+  }
+  failed |= MPI_File_close(&fh) != MPI_SUCCESS;
+  return failed;
+}
+
+static float clamp_rating(float prediction) {
+  if (prediction > 5.0f)
+    prediction = 5.0f;
+  if (prediction < 0.5f)
+    prediction = 0.5f;
+  return prediction;
+}
+
+int main(int argc, char **argv) {
+  int rank, size;
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (provided < MPI_THREAD_FUNNELED) {
+    if (rank == 0)
+      fprintf(stderr, "Error: MPI library does not support "
+                      "MPI_THREAD_FUNNELED\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  const char *model_file = MODEL_FILE;
+  const char *user_file = NULL;
+  const char *output_file = NULL;
+  int top_k = TOP_K;
+  int csv = 0;
+  int bad_args = argc < 2;
+  for (int i = 2; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      top_k = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+      user_file = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output_file = argv[++i];
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      model_file = argv[++i];
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = 1;
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || top_k <= 0) {
+    if (rank == 0) {
+      printf("Usage: %s <ratings_file.csv> [-k K] [-u user_ids.txt] "
+             "[-o output] [-m model.bin] [--csv]\n",
+             argv[0]);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  if (!output_file)
+    output_file = csv ? "recommendations.csv" : "recommendations.bin";
+
+  double start_time = MPI_Wtime();
+
+  Model *model = load_model(model_file);
+  if (!model) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  Dataset *dataset = load_dataset(argv[1], rank);
+  IDMapper *mapper = create_id_mapper(dataset);
+  remap_ids(dataset, mapper);
+  if (dataset->num_users != model->num_users ||
+      dataset->num_movies != model->num_movies) {
+    if (rank == 0) {
+      fprintf(stderr,
+              "Error: %s has %d users and %d movies but %s has %d and %d; "
+              "use the file the model was trained on\n",
+              argv[1], dataset->num_users, dataset->num_movies, model_file,
+              model->num_users, model->num_movies);
+    }
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  RatedItems rated = build_rated_items(dataset, 0.0f);
+
+  int num_users = model->num_users;
+  int *users = NULL;
+  if (user_file) {
+    users = read_user_list(user_file, mapper, dataset, rank, &num_users);
+  }
+  if (top_k > model->num_movies)
+    top_k = model->num_movies;
+
+  int local_start, local_end;
+  owned_range(num_users, rank, size, &local_start, &local_end);
+  int local_count = local_end - local_start;
+  int record_ints = 1 + 2 * top_k;
+  int *records = (int *)malloc((size_t)local_count * record_ints * sizeof(int));
+
+  if (rank == 0) {
+    printf("Recommending top %d for %d users on %d processes x %d threads\n",
+           top_k, num_users, size, omp_get_max_threads());
+  }
+
+  ScoreCatalog *catalog =
+      score_catalog_create(model->movie_feature_data, model->movie_bias,
+                           model->global_mean, model->num_movies,
+                           model->num_factors);
+
+#pragma omp parallel
+  {
+    Candidate *storage = (Candidate *)malloc((size_t)SCORE_USER_PANEL *
+                                             top_k * sizeof(Candidate));
+    TopK topks[SCORE_USER_PANEL];
+    ScoreRequest requests[SCORE_USER_PANEL];
+
+#pragma omp for schedule(dynamic)
+    for (int i0 = 0; i0 < local_count; i0 += SCORE_USER_PANEL) {
+      int n = local_count - i0 < SCORE_USER_PANEL ? local_count - i0
+                                                  : SCORE_USER_PANEL;
+      for (int b = 0; b < n; b++) {
+        int user = users ? users[local_start + i0 + b] : local_start + i0 + b;
+        topk_init(&topks[b], storage + (size_t)b * top_k, top_k);
+        requests[b].profile = model->user_features[user];
+        requests[b].bias = model->user_bias[user];
+        requests[b].excluded = rated.movies + rated.offsets[user];
+        requests[b].num_excluded =
+            rated.offsets[user + 1] - rated.offsets[user];
+        requests[b].topk = &topks[b];
+        requests[b].include_genres = 0;
+        requests[b].exclude_genres = 0;
+      }
+
+      score_topk_batch(catalog, requests, n);
+
+      for (int b = 0; b < n; b++) {
+        int user = users ? users[local_start + i0 + b] : local_start + i0 + b;
+        int *record = records + (size_t)(i0 + b) * record_ints;
+        float *scores = (float *)(record + 1 + top_k);
+        record[0] = mapper->reverse_user_map[user];
+        for (int r = 0; r < top_k; r++) {
+          int found = r < topks[b].size;
+          record[1 + r] =
+              found ? mapper->reverse_movie_map[topks[b].items[r].id] : -1;
+          scores[r] = found ? clamp_rating(topks[b].items[r].score) : 0.0f;
+        }
+      }
+    }
+
+    free(storage);
+  }
+  score_catalog_free(catalog);
+
+  // Written under a temporary name and renamed into place only if every
+  // rank's writes succeeded.
+  char *tmp_file = (char *)malloc(strlen(output_file) + 5);
+  sprintf(tmp_file, "%s.tmp", output_file);
+  int failed;
+  if (csv) {
+    size_t capacity = ((size_t)local_count * top_k + 1) * CSV_LINE_MAX;
+    char *text = (char *)malloc(capacity);
+    long long len = 0;
+    if (rank == 0)
+      len += snprintf(text, capacity, "userId,rank,movieId,score\n");
+    for (int i = 0; i < local_count; i++) {
+      int *record = records + (size_t)i * record_ints;
+      float *scores = (float *)(record + 1 + top_k);
+      for (int r = 0; r < top_k && record[1 + r] >= 0; r++) {
+        len += snprintf(text + len, capacity - len, "%d,%d,%d,%.4f\n",
+                        record[0], r + 1, record[1 + r], scores[r]);
+      }
+    }
+    failed = write_csv(tmp_file, text, len, rank);
+    free(text);
+  } else {
+    failed = write_binary(tmp_file, num_users, top_k, local_start,
+                          local_count, records, rank);
+  }
+  int published = publish_file(tmp_file, output_file, failed, rank);
+  free(tmp_file);
+
+  double elapsed = MPI_Wtime() - start_time;
+  if (rank == 0 && published) {
+    printf("Wrote %s in %.2f seconds\n", output_file, elapsed);
+  }
+
+  free(records);
+  free(users);
+  free_rated_items(&rated);
+  free_id_mapper(mapper);
+  free_dataset(dataset);
+  free_model(model);
+
+  MPI_Finalize();
+  return published ? 0 : 1;
+}
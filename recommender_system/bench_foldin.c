@@ -0,0 +1,200 @@
+#include "config.h"
+#include "foldin.h"
+#include "model.h"
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The per-user solver fold-in used before the dual and blocked paths: the
+// full (k+1) x (k+1) normal matrix, built one rating at a time and solved
+// with an unblocked Cholesky, with fresh buffers for every user. Kept here
+// as the baseline the current solvers are measured against.
+static int baseline_cholesky(double *a, double *b, int n) {
+  for (int j = 0; j < n; j++) {
+    double d = a[j * n + j];
+    for (int p = 0; p < j; p++)
+      d -= a[j * n + p] * a[j * n + p];
+    if (d <= 0.0)
+      return 0;
+    d = sqrt(d);
+    a[j * n + j] = d;
+    for (int i = j + 1; i < n; i++) {
+      double s = a[i * n + j];
+      for (int p = 0; p < j; p++)
+        s -= a[i * n + p] * a[j * n + p];
+      a[i * n + j] = s / d;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    double s = b[i];
+    for (int p = 0; p < i; p++)
+      s -= a[i * n + p] * b[p];
+    b[i] = s / a[i * n + i];
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double s = b[i];
+    for (int p = i + 1; p < n; p++)
+      s -= a[p * n + i] * b[p];
+    b[i] = s / a[i * n + i];
+  }
+  return 1;
+}
+
+static int baseline_fold_in(const Model *model, const UserRating *ratings,
+                            int num_ratings, float regularization,
+                            float *profile, float *bias) {
+  int k = model->num_factors;
+  int n = k + 1;
+  double *a = (double *)calloc((size_t)n * n, sizeof(double));
+  double *b = (double *)calloc(n, sizeof(double));
+
+  for (int r = 0; r < num_ratings; r++) {
+    int movie_id = ratings[r].movie_id;
+    const float *v = model->movie_features[movie_id];
+    double target =
+        ratings[r].rating - model->global_mean - model->movie_bias[movie_id];
+
+    for (int i = 0; i < k; i++) {
+      for (int j = 0; j <= i; j++)
+        a[i * n + j] += (double)v[i] * v[j];
+      a[k * n + i] += v[i];
+      b[i] += v[i] * target;
+    }
+    a[k * n + k] += 1.0;
+    b[k] += target;
+  }
+
+  double lambda = (double)regularization * (num_ratings > 0 ? num_ratings : 1);
+  for (int i = 0; i < n; i++)
+    a[i * n + i] += lambda;
+
+  int ok = baseline_cholesky(a, b, n);
+  for (int i = 0; i < k; i++)
+    profile[i] = ok ? (float)b[i] : 0.0f;
+  *bias = ok ? (float)b[k] : 0.0f;
+
+  free(a);
+  free(b);
+  return ok;
+}
+
+static double max_difference(const float *a, const float *a_bias,
+                             const float *b, const float *b_bias,
+                             int num_users, int k) {
+  double max_diff = 0.0;
+  for (size_t i = 0; i < (size_t)num_users * k; i++)
+    max_diff = fmax(max_diff, fabs(a[i] - b[i]));
+  for (int u = 0; u < num_users; u++)
+    max_diff = fmax(max_diff, fabs(a_bias[u] - b_bias[u]));
+  return max_diff;
+}
+
+// Synthetic cold-start burst: each new user copies a trained user's tastes,
+// rating random movies with that user's rounded predicted rating. Compares
+// the baseline solver, one fold_in_user call per user, and a single batched
+// fold_in_users call.
+int main(int argc, char **argv) {
+  int num_users = 10000;
+  int num_ratings = 20;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      num_users = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      num_ratings = atoi(argv[++i]);
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_users <= 0 || num_ratings <= 0) {
+    printf("Usage: %s [-n users] [-r ratings_per_user]\n", argv[0]);
+    return 1;
+  }
+
+  Model *model = load_model(MODEL_FILE);
+  if (!model)
+    return 1;
+  int k = model->num_factors;
+  if (num_ratings > model->num_movies)
+    num_ratings = model->num_movies;
+
+  int *offsets = (int *)malloc((num_users + 1) * sizeof(int));
+  UserRating *ratings =
+      (UserRating *)malloc((size_t)num_users * num_ratings * sizeof(UserRating));
+  for (int u = 0; u < num_users; u++) {
+    offsets[u] = u * num_ratings;
+    int source = (int)(splitmix64(u) % model->num_users);
+    for (int r = 0; r < num_ratings; r++) {
+      int movie = (int)(splitmix64(((uint64_t)u << 20) + r) % model->num_movies);
+      float prediction = model->global_mean + model->user_bias[source] +
+                         model->movie_bias[movie];
+      for (int f = 0; f < k; f++)
+        prediction += model->user_features[source][f] *
+                      model->movie_features[movie][f];
+      float rating = roundf(prediction * 2.0f) / 2.0f;
+      ratings[offsets[u] + r].movie_id = movie;
+      ratings[offsets[u] + r].rating =
+          rating < 0.5f ? 0.5f : (rating > 5.0f ? 5.0f : rating);
+    }
+  }
+  offsets[num_users] = num_users * num_ratings;
+
+  float *baseline = (float *)malloc((size_t)num_users * k * sizeof(float));
+  float *baseline_bias = (float *)malloc(num_users * sizeof(float));
+  float *single = (float *)malloc((size_t)num_users * k * sizeof(float));
+  float *single_bias = (float *)malloc(num_users * sizeof(float));
+  float *batched = (float *)malloc((size_t)num_users * k * sizeof(float));
+  float *batched_bias = (float *)malloc(num_users * sizeof(float));
+
+  double start = omp_get_wtime();
+  for (int u = 0; u < num_users; u++) {
+    baseline_fold_in(model, ratings + offsets[u], num_ratings,
+                     FOLDIN_REGULARIZATION, baseline + (size_t)u * k,
+                     &baseline_bias[u]);
+  }
+  double baseline_time = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  for (int u = 0; u < num_users; u++) {
+    fold_in_user(model, ratings + offsets[u], num_ratings,
+                 FOLDIN_REGULARIZATION, single + (size_t)u * k,
+                 &single_bias[u]);
+  }
+  double single_time = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  int solved = fold_in_users(model, offsets, ratings, num_users,
+                             FOLDIN_REGULARIZATION, batched, batched_bias);
+  double batched_time = omp_get_wtime() - start;
+
+  printf("%d users x %d ratings, %d factors, %d threads\n", num_users,
+         num_ratings, k, omp_get_max_threads());
+  printf("%-14s %12s %9s %12s\n", "method", "users/s", "speedup",
+         "max diff");
+  printf("%-14s %12.0f %8.2fx %12s\n", "baseline", num_users / baseline_time,
+         1.0, "-");
+  printf("%-14s %12.0f %8.2fx %12.2e\n", "one at a time",
+         num_users / single_time, baseline_time / single_time,
+         max_difference(baseline, baseline_bias, single, single_bias,
+                        num_users, k));
+  printf("%-14s %12.0f %8.2fx %12.2e\n", "batched", num_users / batched_time,
+         baseline_time / batched_time,
+         max_difference(baseline, baseline_bias, batched, batched_bias,
+                        num_users, k));
+  printf("Solved %d of %d\n", solved, num_users);
+
+  free(offsets);
+  free(ratings);
+  free(baseline);
+  free(baseline_bias);
+  free(single);
+  free(single_bias);
+  free(batched);
+  free(batched_bias);
+  free_model(model);
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "config.h"
+#include "mips_index.h"
+#include "model.h"
+#include "quant_score.h"
+#include "score.h"
+#include "topk.h"
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static long long count_hits(const TopK *found, const TopK *truth) {
+  long long hits = 0;
+  for (int i = 0; i < found->size; i++) {
+    for (int j = 0; j < truth->size; j++) {
+      if (found->items[i].id == truth->items[j].id) {
+        hits++;
+        break;
+      }
+    }
+  }
+  return hits;
+}
+
+// Queries are the trained user profiles; ground truth is the exact blocked
+// scan, and recall@K is the fraction of the exact top K each method returns.
+int main(int argc, char **argv) {
+  int num_queries = 1000;
+  int top_k = TOP_K;
+  int rerank = ANN_RERANK;
+  int quant_rerank = QUANT_RERANK;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      num_queries = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      top_k = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rerank") == 0 && i + 1 < argc) {
+      rerank = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--quant-rerank") == 0 && i + 1 < argc) {
+      quant_rerank = atoi(argv[++i]);
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_queries <= 0 || top_k <= 0) {
+    printf("Usage: %s [-n queries] [-k K] [--rerank R] [--quant-rerank R]\n",
+           argv[0]);
+    return 1;
+  }
+
+  Model *model = load_model(MODEL_FILE);
+  if (!model)
+    return 1;
+  MipsIndex *index = mips_index_load(INDEX_FILE);
+  if (index && (index->num_movies != model->num_movies ||
+                index->num_factors != model->num_factors)) {
+    mips_index_free(index);
+    index = NULL;
+  }
+  if (!index) {
+    fprintf(stderr, "No matching %s; run ./build_index to benchmark it\n",
+            INDEX_FILE);
+  }
+  if (num_queries > model->num_users)
+    num_queries = model->num_users;
+  if (top_k > model->num_movies)
+    top_k = model->num_movies;
+
+  Candidate *exact = (Candidate *)malloc((size_t)num_queries * top_k *
+                                         sizeof(Candidate));
+  TopK *exact_topk = (TopK *)malloc(num_queries * sizeof(TopK));
+  ScoreRequest *requests =
+      (ScoreRequest *)malloc(num_queries * sizeof(ScoreRequest));
+  for (int q = 0; q < num_queries; q++) {
+    topk_init(&exact_topk[q], exact + (size_t)q * top_k, top_k);
+    requests[q].profile = model->user_features[q];
+    requests[q].bias = model->user_bias[q];
+    requests[q].excluded = NULL;
+    requests[q].num_excluded = 0;
+    requests[q].topk = &exact_topk[q];
+    requests[q].include_genres = 0;
+    requests[q].exclude_genres = 0;
+  }
+
+  ScoreCatalog *catalog =
+      score_catalog_create(model->movie_feature_data, model->movie_bias,
+                           model->global_mean, model->num_movies,
+                           model->num_factors);
+  double start = omp_get_wtime();
+  for (int q = 0; q < num_queries; q++)
+    score_topk_batch(catalog, &requests[q], 1);
+  double exact_time = omp_get_wtime() - start;
+  score_catalog_free(catalog);
+
+  printf("%d queries, %d movies, K=%d\n", num_queries, model->num_movies,
+         top_k);
+  printf("%-8s %10s %12s\n", "method", "recall@K", "QPS");
+  printf("%-8s %10.4f %12.0f\n", "exact", 1.0, num_queries / exact_time);
+
+  // Full scans of the compact row formats, each rescoring its best
+  // quant_rerank estimates in fp32.
+  Candidate *items = (Candidate *)malloc(top_k * sizeof(Candidate));
+  printf("\nQuantized scan, rerank=%d\n", quant_rerank);
+  printf("%-8s %10s %12s %12s\n", "format", "recall@K", "QPS", "bytes/movie");
+  for (int p = PRECISION_FP32; p <= PRECISION_INT8; p++) {
+    QuantCatalog *quant = quant_catalog_create(model, (Precision)p, NULL);
+    long long hits = 0;
+    double elapsed = 0.0;
+    for (int q = 0; q < num_queries; q++) {
+      TopK topk;
+      topk_init(&topk, items, top_k);
+      start = omp_get_wtime();
+      quant_search(quant, model, model->user_features[q],
+                   model->user_bias[q], NULL, 0, quant_rerank, &topk);
+      elapsed += omp_get_wtime() - start;
+      hits += count_hits(&topk, &exact_topk[q]);
+    }
+    printf("%-8s %10.4f %12.0f %12zu\n", precision_name((Precision)p),
+           (double)hits / ((double)num_queries * top_k),
+           num_queries / elapsed, quant_catalog_movie_bytes(quant));
+    quant_catalog_free(quant);
+  }
+
+  if (index)
+    printf("\nIVF-PQ index, rerank=%d\n", rerank);
+  for (int nprobe = 1; index && nprobe <= index->num_lists; nprobe *= 2) {
+    long long hits = 0;
+    double elapsed = 0.0;
+    for (int q = 0; q < num_queries; q++) {
+      TopK topk;
+      topk_init(&topk, items, top_k);
+      start = omp_get_wtime();
+      mips_index_search(index, model, model->user_features[q],
+                        model->user_bias[q], NULL, 0, nprobe, rerank, &topk);
+      elapsed += omp_get_wtime() - start;
+      hits += count_hits(&topk, &exact_topk[q]);
+    }
+    printf("%-8d %10.4f %12.0f\n", nprobe,
+           (double)hits / ((double)num_queries * top_k),
+           num_queries / elapsed);
+  }
+
+  free(items);
+  free(exact);
+  free(exact_topk);
+  free(requests);
+  mips_index_free(index);
+  free_model(model);
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include "config.h"
+#include "recsys.h"
+#include <omp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Per-call latency of the embeddable library. Every thread shares one loaded
+// model and issues its own stream of fold-in, top-K and full recommend calls
+// for random users, the way a host service would.
+
+enum { OP_FOLD_IN, OP_TOP_K, OP_RECOMMEND, NUM_OPS };
+
+static const char *op_names[NUM_OPS] = {"fold-in", "top-k", "recommend"};
+
+typedef struct {
+  const RecsysModel *model;
+  int num_calls;
+  int num_ratings;
+  int top_k;
+  uint64_t seed;
+  double *latencies[NUM_OPS];
+  int errors;
+} Worker;
+
+static uint64_t next_random(uint64_t *state) {
+  uint64_t x = (*state += 0x9E3779B97F4A7C15ULL);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static void *run_worker(void *arg) {
+  Worker *worker = (Worker *)arg;
+  const RecsysModel *model = worker->model;
+  int num_movies = recsys_num_movies(model);
+  RecsysRating *ratings =
+      (RecsysRating *)malloc(worker->num_ratings * sizeof(RecsysRating));
+  int *rated = (int *)malloc(worker->num_ratings * sizeof(int));
+  RecsysItem *items = (RecsysItem *)malloc(worker->top_k * sizeof(RecsysItem));
+  float *profile = (float *)malloc(recsys_num_factors(model) * sizeof(float));
+  uint64_t state = worker->seed;
+
+  for (int call = 0; call < worker->num_calls; call++) {
+    for (int r = 0; r < worker->num_ratings; r++) {
+      int movie = (int)(next_random(&state) % num_movies);
+      ratings[r].movie_id = recsys_movie_id(model, movie);
+      ratings[r].rating = 0.5f * (1 + next_random(&state) % 10);
+      rated[r] = ratings[r].movie_id;
+    }
+
+    float bias;
+    int num_items;
+    double start = omp_get_wtime();
+    RecsysStatus status = recsys_fold_in(model, ratings, worker->num_ratings,
+                                         profile, &bias);
+    double mid = omp_get_wtime();
+    if (status == RECSYS_OK)
+      status = recsys_top_k(model, profile, bias, rated, worker->num_ratings,
+                            worker->top_k, items, &num_items);
+    double end = omp_get_wtime();
+    if (status == RECSYS_OK)
+      status = recsys_recommend(model, ratings, worker->num_ratings,
+                                worker->top_k, items, &num_items);
+    double after = omp_get_wtime();
+
+    worker->latencies[OP_FOLD_IN][call] = mid - start;
+    worker->latencies[OP_TOP_K][call] = end - mid;
+    worker->latencies[OP_RECOMMEND][call] = after - end;
+    worker->errors += status != RECSYS_OK;
+  }
+
+  free(ratings);
+  free(rated);
+  free(items);
+  free(profile);
+  return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+  const char *serving_file = SERVING_FILE;
+  const char *mapping_file = MAPPING_FILE;
+  int num_threads = 1;
+  int num_calls = 1000;
+  int num_ratings = 20;
+  int top_k = 10;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      num_calls = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      num_ratings = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      top_k = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-m") == 0 && i + 2 < argc) {
+      serving_file = argv[++i];
+      mapping_file = argv[++i];
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_threads <= 0 || num_calls <= 0 || num_ratings <= 0 ||
+      top_k <= 0) {
+    printf("Usage: %s [-t threads] [-n calls_per_thread] [-r ratings] [-k K] "
+           "[-m serving_model mapping]\n",
+           argv[0]);
+    return 1;
+  }
+
+  RecsysModel *model;
+  RecsysStatus status = recsys_load(serving_file, mapping_file, &model);
+  if (status != RECSYS_OK) {
+    fprintf(stderr, "Error loading %s: %s\n", serving_file,
+            recsys_status_string(status));
+    return 1;
+  }
+
+  size_t total = (size_t)num_threads * num_calls;
+  double *latencies[NUM_OPS];
+  for (int op = 0; op < NUM_OPS; op++)
+    latencies[op] = (double *)malloc(total * sizeof(double));
+  Worker *workers = (Worker *)calloc(num_threads, sizeof(Worker));
+  pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+
+  double start = omp_get_wtime();
+  for (int t = 0; t < num_threads; t++) {
+    workers[t].model = model;
+    workers[t].num_calls = num_calls;
+    workers[t].num_ratings = num_ratings;
+    workers[t].top_k = top_k;
+    workers[t].seed = RANDOM_SEED + t;
+    for (int op = 0; op < NUM_OPS; op++)
+      workers[t].latencies[op] = latencies[op] + (size_t)t * num_calls;
+    pthread_create(&threads[t], NULL, run_worker, &workers[t]);
+  }
+  int errors = 0;
+  for (int t = 0; t < num_threads; t++) {
+    pthread_join(threads[t], NULL);
+    errors += workers[t].errors;
+  }
+  double elapsed = omp_get_wtime() - start;
+
+  printf("%d movies, %d factors, %d threads x %d calls, %d ratings, top %d\n",
+         recsys_num_movies(model), recsys_num_factors(model), num_threads,
+         num_calls, num_ratings, top_k);
+  printf("%-10s %10s %10s %10s %10s\n", "call", "mean ms", "p50 ms", "p99 ms",
+         "max ms");
+  for (int op = 0; op < NUM_OPS; op++) {
+    double sum = 0.0;
+    for (size_t i = 0; i < total; i++)
+      sum += latencies[op][i];
+    qsort(latencies[op], total, sizeof(double), compare_doubles);
+    printf("%-10s %10.4f %10.4f %10.4f %10.4f\n", op_names[op],
+           1e3 * sum / total, 1e3 * latencies[op][total / 2],
+           1e3 * latencies[op][total * 99 / 100],
+           1e3 * latencies[op][total - 1]);
+  }
+  printf("%zu users in %.2f s (%d errors)\n", total, elapsed, errors);
+
+  for (int op = 0; op < NUM_OPS; op++)
+    free(latencies[op]);
+  free(workers);
+  free(threads);
+  recsys_free(model);
+  return 0;
+}
@@ -0,0 +1,36 @@
+#include "catalog.h"
+#include "config.h"
+#include "movies.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  const char *movies_csv = "data/movies.csv";
+  const char *catalog_file = CATALOG_FILE;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      catalog_file = argv[++i];
+    } else if (argv[i][0] != '-') {
+      movies_csv = argv[i];
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args) {
+    printf("Usage: %s [movies.csv] [-o %s]\n", argv[0], CATALOG_FILE);
+    return 1;
+  }
+
+  int num_movies;
+  int *original_ids = load_movie_mapping(MAPPING_FILE, &num_movies);
+  if (!original_ids)
+    return 1;
+  int ok = catalog_build(movies_csv, original_ids, num_movies, catalog_file);
+  if (ok)
+    printf("Catalog saved to %s\n", catalog_file);
+  free(original_ids);
+  return ok ? 0 : 1;
+}
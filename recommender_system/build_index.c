@@ -0,0 +1,56 @@
+#include "config.h"
+#include "mips_index.h"
+#include "model.h"
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  const char *model_file = MODEL_FILE;
+  const char *index_file = INDEX_FILE;
+  int num_lists = 0;
+  int num_subspaces = ANN_SUBSPACES;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      model_file = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      index_file = argv[++i];
+    } else if (strcmp(argv[i], "--lists") == 0 && i + 1 < argc) {
+      num_lists = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--subspaces") == 0 && i + 1 < argc) {
+      num_subspaces = atoi(argv[++i]);
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_lists < 0 || num_subspaces <= 0) {
+    printf("Usage: %s [-m model.bin] [-o %s] [--lists N] [--subspaces M]\n",
+           argv[0], INDEX_FILE);
+    return 1;
+  }
+
+  Model *model = load_model(model_file);
+  if (!model)
+    return 1;
+  if (num_lists == 0)
+    num_lists = (int)sqrt((double)model->num_movies) + 1;
+
+  double start = omp_get_wtime();
+  MipsIndex *index =
+      mips_index_build(model, num_lists, num_subspaces, RANDOM_SEED);
+  printf("Built index: %d movies, %d lists, %d subspaces of %d dims, "
+         "%d codewords (%.2f s)\n",
+         index->num_movies, index->num_lists, index->num_subspaces,
+         index->sub_dim, index->num_codewords, omp_get_wtime() - start);
+
+  int ok = mips_index_save(index, index_file);
+  if (ok)
+    printf("Index saved to %s\n", index_file);
+  mips_index_free(index);
+  free_model(model);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+#include "config.h"
+#include "model.h"
+#include "model_io.h"
+#include "neighbors.h"
+#include "score.h"
+#include "topk.h"
+#include <math.h>
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every rank writes its movie range of both sections at computed offsets,
+// then rank 0 renames the finished file into place if no rank failed.
+// Returns 1 on every rank if the file was published.
+static int write_neighbors(const char *filename, int num_movies,
+                           int num_neighbors, int local_start, int local_count,
+                           const int32_t *ids, const float *similarities,
+                           int rank) {
+  char *tmp_filename = (char *)malloc(strlen(filename) + 5);
+  sprintf(tmp_filename, "%s.tmp", filename);
+  MPI_File fh;
+  int failed = MPI_File_open(MPI_COMM_WORLD, tmp_filename,
+                             MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                             &fh) != MPI_SUCCESS;
+
+  NeighborHeader head = {NEIGHBORS_MAGIC, (uint32_t)num_movies,
+                         (uint32_t)num_neighbors, 0};
+  MPI_Offset cells = (MPI_Offset)num_movies * num_neighbors;
+  MPI_Offset row_start = (MPI_Offset)local_start * num_neighbors;
+  MPI_Offset ids_offset = sizeof(head);
+  MPI_Offset similarities_offset = ids_offset + cells * sizeof(int32_t);
+  int local_cells = local_count * num_neighbors;
+
+  // A failed open fails on every rank, so the collective calls are skipped
+  // together.
+  if (!failed) {
+    failed |= MPI_File_set_size(fh, similarities_offset +
+                                        cells * sizeof(float)) != MPI_SUCCESS;
+    failed |= !write_slice(fh, 0, &head, rank == 0 ? (int)sizeof(head) : 0,
+                           MPI_BYTE);
+    failed |= !write_slice(fh, ids_offset + row_start * sizeof(int32_t), ids,
+                           local_cells, MPI_INT);
+    failed |= !write_slice(fh, similarities_offset + row_start * sizeof(float),
+                           similarities, local_cells, MPI_FLOAT);
+    failed |= MPI_File_close(&fh) != MPI_SUCCESS;
+  }
+
+  int published = publish_file(tmp_filename, filename, failed, rank);
+  free(tmp_filename);
+  return published;
+}
+
+int main(int argc, char **argv) {
+  int rank, size;
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  const char *model_file = MODEL_FILE;
+  const char *output_file = NEIGHBORS_FILE;
+  int num_neighbors = NUM_NEIGHBORS;
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      num_neighbors = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      model_file = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output_file = argv[++i];
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_neighbors <= 0) {
+    if (rank == 0) {
+      printf("Usage: %s [-n neighbors] [-m model.bin] [-o %s]\n", argv[0],
+             NEIGHBORS_FILE);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+
+  double start_time = MPI_Wtime();
+
+  Model *model = load_model(model_file);
+  if (!model) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  int num_movies = model->num_movies;
+  int num_factors = model->num_factors;
+  if (num_neighbors > num_movies - 1)
+    num_neighbors = num_movies - 1 > 0 ? num_movies - 1 : 1;
+
+  // Cosine similarity is the inner product of unit vectors, so the blocked
+  // top-K kernel does the all-pairs work with zero biases. Movies with a zero
+  // factor vector score 0 against everything.
+  float *unit = (float *)malloc((size_t)num_movies * num_factors *
+                                sizeof(float));
+  float *zero_bias = (float *)calloc(num_movies, sizeof(float));
+#pragma omp parallel for schedule(static)
+  for (int j = 0; j < num_movies; j++) {
+    const float *row = model->movie_features[j];
+    float *out = unit + (size_t)j * num_factors;
+    double norm = 0.0;
+    for (int k = 0; k < num_factors; k++)
+      norm += (double)row[k] * row[k];
+    float scale = norm > 0.0 ? (float)(1.0 / sqrt(norm)) : 0.0f;
+    for (int k = 0; k < num_factors; k++)
+      out[k] = row[k] * scale;
+  }
+  ScoreCatalog *catalog = score_catalog_create(unit, zero_bias, 0.0f,
+                                               num_movies, num_factors);
+
+  int local_start, local_end;
+  owned_range(num_movies, rank, size, &local_start, &local_end);
+  int local_count = local_end - local_start;
+  size_t local_cells = (size_t)local_count * num_neighbors;
+  int32_t *ids = (int32_t *)malloc((local_cells + 1) * sizeof(int32_t));
+  float *similarities = (float *)malloc((local_cells + 1) * sizeof(float));
+
+  if (rank == 0) {
+    printf("Computing %d neighbors for %d movies on %d processes x %d "
+           "threads\n",
+           num_neighbors, num_movies, size, omp_get_max_threads());
+  }
+
+#pragma omp parallel
+  {
+    Candidate *storage = (Candidate *)malloc((size_t)SCORE_USER_PANEL *
+                                             num_neighbors * sizeof(Candidate));
+    TopK topks[SCORE_USER_PANEL];
+    ScoreRequest requests[SCORE_USER_PANEL];
+    int self[SCORE_USER_PANEL];
+
+#pragma omp for schedule(dynamic)
+    for (int i0 = 0; i0 < local_count; i0 += SCORE_USER_PANEL) {
+      int n = local_count - i0 < SCORE_USER_PANEL ? local_count - i0
+                                                  : SCORE_USER_PANEL;
+      for (int b = 0; b < n; b++) {
+        int movie = local_start + i0 + b;
+        self[b] = movie;
+        topk_init(&topks[b], storage + (size_t)b * num_neighbors,
+                  num_neighbors);
+        requests[b].profile = unit + (size_t)movie * num_factors;
+        requests[b].bias = 0.0f;
+        requests[b].excluded = &self[b];
+        requests[b].num_excluded = 1;
+        requests[b].topk = &topks[b];
+        requests[b].include_genres = 0;
+        requests[b].exclude_genres = 0;
+      }
+
+      score_topk_batch(catalog, requests, n);
+
+      for (int b = 0; b < n; b++) {
+        size_t row = (size_t)(i0 + b) * num_neighbors;
+        for (int r = 0; r < num_neighbors; r++) {
+          int found = r < topks[b].size;
+          ids[row + r] = found ? topks[b].items[r].id : -1;
+          similarities[row + r] = found ? topks[b].items[r].score : 0.0f;
+        }
+      }
+    }
+
+    free(storage);
+  }
+  score_catalog_free(catalog);
+
+  int published =
+      write_neighbors(output_file, num_movies, num_neighbors, local_start,
+                      local_count, ids, similarities, rank);
+
+  double elapsed = MPI_Wtime() - start_time;
+  if (rank == 0 && published) {
+    printf("Wrote %s in %.2f seconds\n", output_file, elapsed);
+  }
+
+  free(ids);
+  free(similarities);
+  free(unit);
+  free(zero_bias);
+  free_model(model);
+
+  MPI_Finalize();
+  return published ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "catalog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} StringBuffer;
+
+static uint32_t append_string(StringBuffer *buffer, const char *s) {
+  size_t len = strlen(s) + 1;
+  if (buffer->len + len > buffer->cap) {
+    while (buffer->len + len > buffer->cap)
+      buffer->cap = buffer->cap ? 2 * buffer->cap : 4096;
+    buffer->data = (char *)realloc(buffer->data, buffer->cap);
+  }
+  memcpy(buffer->data + buffer->len, s, len);
+  uint32_t offset = (uint32_t)buffer->len;
+  buffer->len += len;
+  return offset;
+}
+
+// Reads one CSV record, joining physical lines while a quoted field is open.
+static int read_record(FILE *f, char **record, size_t *cap) {
+  char *line = NULL;
+  size_t line_cap = 0;
+  size_t len = 0;
+  int in_quotes = 0;
+  ssize_t n;
+  while ((n = getline(&line, &line_cap, f)) > 0) {
+    if (len + n + 1 > *cap) {
+      *cap = 2 * (len + n + 1);
+      *record = (char *)realloc(*record, *cap);
+    }
+    memcpy(*record + len, line, n + 1);
+    len += n;
+    for (ssize_t i = 0; i < n; i++) {
+      if (line[i] == '"')
+        in_quotes = !in_quotes;
+    }
+    if (!in_quotes)
+      break;
+  }
+  free(line);
+  while (len > 0 && ((*record)[len - 1] == '\n' || (*record)[len - 1] == '\r'))
+    (*record)[--len] = '\0';
+  return len > 0 || n > 0;
+}
+
+// Splits a record in place, removing quotes and unescaping doubled quotes.
+static int split_fields(char *record, char **fields, int max_fields) {
+  int num_fields = 0;
+  char *in = record;
+  while (num_fields < max_fields) {
+    char *out = in;
+    fields[num_fields++] = out;
+    if (*in == '"') {
+      in++;
+      while (*in) {
+        if (*in == '"' && in[1] == '"') {
+          *out++ = '"';
+          in += 2;
+        } else if (*in == '"') {
+          in++;
+          break;
+        } else {
+          *out++ = *in++;
+        }
+      }
+    }
+    while (*in && *in != ',')
+      *out++ = *in++;
+    int more = *in == ',';
+    *out = '\0';
+    if (!more)
+      break;
+    in++;
+  }
+  return num_fields;
+}
+
+typedef struct {
+  int original_id;
+  int movie;
+} IdEntry;
+
+static int compare_id_entries(const void *a, const void *b) {
+  int x = ((const IdEntry *)a)->original_id;
+  int y = ((const IdEntry *)b)->original_id;
+  return (x > y) - (x < y);
+}
+
+static int write_section(FILE *f, const void *data, size_t size, size_t n) {
+  return n == 0 || fwrite(data, size, n, f) == n;
+}
+
+int catalog_build(const char *movies_csv, const int *original_ids,
+                  int num_movies, const char *filename) {
+  FILE *in = fopen(movies_csv, "r");
+  if (!in) {
+    fprintf(stderr, "Error opening %s: %s\n", movies_csv, strerror(errno));
+    return 0;
+  }
+
+  IdEntry *lookup = (IdEntry *)malloc(num_movies * sizeof(IdEntry));
+  for (int i = 0; i < num_movies; i++) {
+    lookup[i].original_id = original_ids[i];
+    lookup[i].movie = i;
+  }
+  qsort(lookup, num_movies, sizeof(IdEntry), compare_id_entries);
+
+  uint64_t *genre_masks = (uint64_t *)calloc(num_movies, sizeof(uint64_t));
+  uint32_t *title_offsets = (uint32_t *)malloc(num_movies * sizeof(uint32_t));
+  uint32_t *genre_offsets = (uint32_t *)malloc(num_movies * sizeof(uint32_t));
+  for (int i = 0; i < num_movies; i++) {
+    title_offsets[i] = CATALOG_NO_STRING;
+    genre_offsets[i] = CATALOG_NO_STRING;
+  }
+  char *genre_names[CATALOG_MAX_GENRES];
+  int num_genres = 0;
+  int dropped_genres = 0;
+
+  StringBuffer strings = {NULL, 0, 0};
+  char *record = NULL;
+  size_t record_cap = 0;
+  int found = 0;
+  int header = 1;
+  while (read_record(in, &record, &record_cap)) {
+    if (header) {
+      header = 0;
+      continue;
+    }
+    char *fields[3];
+    if (split_fields(record, fields, 3) < 3)
+      continue;
+    IdEntry key = {atoi(fields[0]), 0};
+    IdEntry *entry = (IdEntry *)bsearch(&key, lookup, num_movies,
+                                        sizeof(IdEntry), compare_id_entries);
+    if (!entry || title_offsets[entry->movie] != CATALOG_NO_STRING)
+      continue;
+    int movie = entry->movie;
+    title_offsets[movie] = append_string(&strings, fields[1]);
+    genre_offsets[movie] = append_string(&strings, fields[2]);
+    found++;
+
+    for (char *genre = strtok(fields[2], "|"); genre;
+         genre = strtok(NULL, "|")) {
+      if (strcmp(genre, "(no genres listed)") == 0)
+        continue;
+      int g = 0;
+      while (g < num_genres && strcmp(genre_names[g], genre) != 0)
+        g++;
+      if (g == num_genres) {
+        if (num_genres == CATALOG_MAX_GENRES) {
+          dropped_genres++;
+          continue;
+        }
+        genre_names[num_genres] = (char *)malloc(strlen(genre) + 1);
+        strcpy(genre_names[num_genres++], genre);
+      }
+      genre_masks[movie] |= 1ULL << g;
+    }
+  }
+  fclose(in);
+  free(record);
+  free(lookup);
+
+  uint32_t genre_name_offsets[CATALOG_MAX_GENRES];
+  for (int g = 0; g < num_genres; g++) {
+    genre_name_offsets[g] = append_string(&strings, genre_names[g]);
+    free(genre_names[g]);
+  }
+  if (dropped_genres > 0) {
+    fprintf(stderr, "Warning: only the first %d genres get bitmask bits\n",
+            CATALOG_MAX_GENRES);
+  }
+
+  CatalogHeader head = {CATALOG_MAGIC, CATALOG_VERSION, (uint32_t)num_movies,
+                        (uint32_t)num_genres, strings.len};
+  char *tmp_filename = (char *)malloc(strlen(filename) + 5);
+  sprintf(tmp_filename, "%s.tmp", filename);
+  FILE *out = fopen(tmp_filename, "wb");
+  int ok = out && fwrite(&head, sizeof(head), 1, out) == 1 &&
+           write_section(out, genre_masks, sizeof(uint64_t), num_movies) &&
+           write_section(out, original_ids, sizeof(int32_t), num_movies) &&
+           write_section(out, title_offsets, sizeof(uint32_t), num_movies) &&
+           write_section(out, genre_offsets, sizeof(uint32_t), num_movies) &&
+           write_section(out, genre_name_offsets, sizeof(uint32_t),
+                         num_genres) &&
+           write_section(out, strings.data, 1, strings.len);
+  if (out && fclose(out) != 0)
+    ok = 0;
+  if (!ok || rename(tmp_filename, filename) != 0) {
+    fprintf(stderr, "Error writing %s: %s\n", filename, strerror(errno));
+    remove(tmp_filename);
+    ok = 0;
+  } else {
+    printf("Catalog: %d of %d movies titled, %d genres, %zu bytes of "
+           "strings\n",
+           found, num_movies, num_genres, strings.len);
+  }
+
+  free(tmp_filename);
+  free(strings.data);
+  free(genre_masks);
+  free(title_offsets);
+  free(genre_offsets);
+  return ok;
+}
+
+// Every string offset must point inside the arena, and the arena must end in
+// a NUL, so no lookup can read past the mapping.
+static int offsets_valid(const uint32_t *offsets, size_t n, int allow_missing,
+                         uint64_t strings_len) {
+  for (size_t i = 0; i < n; i++) {
+    if (allow_missing && offsets[i] == CATALOG_NO_STRING)
+      continue;
+    if (offsets[i] >= strings_len)
+      return 0;
+  }
+  return 1;
+}
+
+// Returns NULL without printing if the file is missing or not a valid
+// catalog.
+Catalog *catalog_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CatalogHeader)) {
+    close(fd);
+    return NULL;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  const CatalogHeader *head = (const CatalogHeader *)base;
+  size_t n = head->num_movies;
+  size_t expected = sizeof(CatalogHeader) + n * sizeof(uint64_t) +
+                    3 * n * sizeof(uint32_t) +
+                    head->num_genres * sizeof(uint32_t) + head->strings_len;
+  if (head->magic != CATALOG_MAGIC || head->version != CATALOG_VERSION ||
+      head->num_genres > CATALOG_MAX_GENRES ||
+      head->strings_len > (uint64_t)st.st_size ||
+      expected != (size_t)st.st_size) {
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  Catalog *catalog = (Catalog *)malloc(sizeof(Catalog));
+  catalog->base = base;
+  catalog->size = st.st_size;
+  catalog->num_movies = (int)n;
+  catalog->num_genres = (int)head->num_genres;
+  const char *p = (const char *)base + sizeof(CatalogHeader);
+  catalog->genre_masks = (const uint64_t *)p;
+  p += n * sizeof(uint64_t);
+  catalog->movie_ids = (const int32_t *)p;
+  p += n * sizeof(int32_t);
+  catalog->title_offsets = (const uint32_t *)p;
+  p += n * sizeof(uint32_t);
+  catalog->genre_offsets = (const uint32_t *)p;
+  p += n * sizeof(uint32_t);
+  catalog->genre_name_offsets = (const uint32_t *)p;
+  p += catalog->num_genres * sizeof(uint32_t);
+  catalog->strings = p;
+
+  uint64_t strings_len = head->strings_len;
+  if ((strings_len > 0 && catalog->strings[strings_len - 1] != '\0') ||
+      !offsets_valid(catalog->title_offsets, n, 1, strings_len) ||
+      !offsets_valid(catalog->genre_offsets, n, 1, strings_len) ||
+      !offsets_valid(catalog->genre_name_offsets, catalog->num_genres, 0,
+                     strings_len)) {
+    catalog_close(catalog);
+    return NULL;
+  }
+  return catalog;
+}
+
+// 1 if the catalog lists exactly these original movie IDs, in this internal
+// order, i.e. it was built against the same movie_mapping.bin.
+int catalog_matches(const Catalog *catalog, const int *movie_ids,
+                    int num_movies) {
+  if (catalog->num_movies != num_movies)
+    return 0;
+  for (int j = 0; j < num_movies; j++) {
+    if (catalog->movie_ids[j] != movie_ids[j])
+      return 0;
+  }
+  return 1;
+}
+
+// Returns the bit index of a genre name, ignoring case, or -1.
+int catalog_find_genre(const Catalog *catalog, const char *name) {
+  for (int g = 0; g < catalog->num_genres; g++) {
+    if (strcasecmp(catalog_genre_name(catalog, g), name) == 0)
+      return g;
+  }
+  return -1;
+}
+
+// Turns a comma-separated list of genre names into a bitmask. Returns 0 if a
+// name is unknown.
+int catalog_genre_mask(const Catalog *catalog, const char *list,
+                       uint64_t *mask) {
+  char name[CATALOG_MAX_GENRE_NAME];
+  *mask = 0;
+  while (*list) {
+    size_t len = strcspn(list, ",");
+    if (len >= sizeof(name))
+      return 0;
+    memcpy(name, list, len);
+    name[len] = '\0';
+    int g = catalog_find_genre(catalog, name);
+    if (g < 0)
+      return 0;
+    *mask |= 1ULL << g;
+    list += len + (list[len] == ',');
+  }
+  return 1;
+}
+
+void catalog_close(Catalog *catalog) {
+  if (catalog) {
+    munmap(catalog->base, catalog->size);
+    free(catalog);
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CATALOG_MAGIC 0x474c5443
+#define CATALOG_VERSION 1
+#define CATALOG_MAX_GENRES 64
+#define CATALOG_NO_STRING 0xFFFFFFFFu
+#define CATALOG_MAX_GENRE_NAME 64
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_movies;
+  uint32_t num_genres;
+  uint64_t strings_len;
+} CatalogHeader;
+
+// Compiled movies.csv, indexed by the internal movie ID of movie_mapping.bin.
+// The file is mapped read-only and every field points into the mapping: the
+// genre bitmasks, original movie IDs, offset tables, then one string arena
+// holding all titles, genre strings and genre names.
+typedef struct {
+  void *base;
+  size_t size;
+  int num_movies;
+  int num_genres;
+  const uint64_t *genre_masks;
+  const int32_t *movie_ids;
+  const uint32_t *title_offsets;
+  const uint32_t *genre_offsets;
+  const uint32_t *genre_name_offsets;
+  const char *strings;
+} Catalog;
+
+int catalog_build(const char *movies_csv, const int *original_ids,
+                  int num_movies, const char *filename);
+Catalog *catalog_open(const char *filename);
+void catalog_close(Catalog *catalog);
+int catalog_matches(const Catalog *catalog, const int *movie_ids,
+                    int num_movies);
+int catalog_find_genre(const Catalog *catalog, const char *name);
+int catalog_genre_mask(const Catalog *catalog, const char *list,
+                       uint64_t *mask);
+
+static inline const char *catalog_title(const Catalog *catalog, int movie) {
+  uint32_t offset = catalog->title_offsets[movie];
+  return offset == CATALOG_NO_STRING ? NULL : catalog->strings + offset;
+}
+
+static inline const char *catalog_genres(const Catalog *catalog, int movie) {
+  uint32_t offset = catalog->genre_offsets[movie];
+  return offset == CATALOG_NO_STRING ? NULL : catalog->strings + offset;
+}
+
+static inline const char *catalog_genre_name(const Catalog *catalog,
+                                             int genre) {
+  return catalog->strings + catalog->genre_name_offsets[genre];
+}
+
+#endif
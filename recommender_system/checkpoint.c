@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC 0x4b43464d
+#define CHECKPOINT_VERSION 1
+
+typedef struct {
+  int magic;
+  int version;
+  int epoch;
+  int num_ranks;
+  int num_users;
+  int num_movies;
+  int num_factors;
+  float global_mean;
+  float learning_rate;
+  float regularization;
+} CheckpointHeader;
+
+// Rank 0 copies the synchronized model into a snapshot buffer and hands it to
+// a writer thread, so SGD only pays for a memcpy. The file is written to a
+// temporary name and renamed into place, so a crash mid-write leaves the
+// previous checkpoint intact.
+struct Checkpointer {
+  char *filename;
+  char *tmp_filename;
+  pthread_t thread;
+  int busy;
+  CheckpointHeader header;
+  float *snapshot;
+  size_t snapshot_len;
+};
+
+static size_t snapshot_length(const Model *model) {
+  return (size_t)model->num_users + model->num_movies +
+         (size_t)model->num_users * model->num_factors +
+         (size_t)model->num_movies * model->num_factors;
+}
+
+static void *write_checkpoint(void *arg) {
+  Checkpointer *ckpt = (Checkpointer *)arg;
+  FILE *f = fopen(ckpt->tmp_filename, "wb");
+  if (!f) {
+    fprintf(stderr, "Error writing checkpoint %s: %s\n", ckpt->tmp_filename,
+            strerror(errno));
+    return NULL;
+  }
+
+  int ok = fwrite(&ckpt->header, sizeof(CheckpointHeader), 1, f) == 1 &&
+           fwrite(ckpt->snapshot, sizeof(float), ckpt->snapshot_len, f) ==
+               ckpt->snapshot_len &&
+           fflush(f) == 0 && fsync(fileno(f)) == 0;
+  if (fclose(f) != 0)
+    ok = 0;
+
+  if (!ok || rename(ckpt->tmp_filename, ckpt->filename) != 0) {
+    fprintf(stderr, "Error writing checkpoint %s: %s\n", ckpt->filename,
+            strerror(errno));
+    remove(ckpt->tmp_filename);
+  }
+  return NULL;
+}
+
+Checkpointer *checkpointer_create(const char *filename, int num_ranks) {
+  Checkpointer *ckpt = (Checkpointer *)calloc(1, sizeof(Checkpointer));
+  ckpt->filename = (char *)malloc(strlen(filename) + 1);
+  strcpy(ckpt->filename, filename);
+  ckpt->tmp_filename = (char *)malloc(strlen(filename) + 5);
+  sprintf(ckpt->tmp_filename, "%s.tmp", filename);
+  ckpt->header.magic = CHECKPOINT_MAGIC;
+  ckpt->header.version = CHECKPOINT_VERSION;
+  ckpt->header.num_ranks = num_ranks;
+  return ckpt;
+}
+
+void checkpointer_submit(Checkpointer *ckpt, Model *model, int epoch) {
+  if (ckpt->busy) {
+    pthread_join(ckpt->thread, NULL);
+    ckpt->busy = 0;
+  }
+
+  size_t len = snapshot_length(model);
+  if (len != ckpt->snapshot_len) {
+    free(ckpt->snapshot);
+    ckpt->snapshot = (float *)malloc(len * sizeof(float));
+    ckpt->snapshot_len = len;
+  }
+
+  ckpt->header.epoch = epoch;
+  ckpt->header.num_users = model->num_users;
+  ckpt->header.num_movies = model->num_movies;
+  ckpt->header.num_factors = model->num_factors;
+  ckpt->header.global_mean = model->global_mean;
+  ckpt->header.learning_rate = model->learning_rate;
+  ckpt->header.regularization = model->regularization;
+
+  float *dst = ckpt->snapshot;
+  memcpy(dst, model->user_bias, model->num_users * sizeof(float));
+  dst += model->num_users;
+  memcpy(dst, model->movie_bias, model->num_movies * sizeof(float));
+  dst += model->num_movies;
+  for (int i = 0; i < model->num_users; i++) {
+    memcpy(dst, model->user_features[i], model->num_factors * sizeof(float));
+    dst += model->num_factors;
+  }
+  for (int i = 0; i < model->num_movies; i++) {
+    memcpy(dst, model->movie_features[i], model->num_factors * sizeof(float));
+    dst += model->num_factors;
+  }
+
+  if (pthread_create(&ckpt->thread, NULL, write_checkpoint, ckpt) == 0) {
+    ckpt->busy = 1;
+  } else {
+    write_checkpoint(ckpt);
+  }
+}
+
+void checkpointer_destroy(Checkpointer *ckpt) {
+  if (ckpt) {
+    if (ckpt->busy) {
+      pthread_join(ckpt->thread, NULL);
+    }
+    free(ckpt->snapshot);
+    free(ckpt->filename);
+    free(ckpt->tmp_filename);
+    free(ckpt);
+  }
+}
+
+int load_checkpoint(const char *filename, Model *model, int *epoch,
+                    int *num_ranks) {
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+    fprintf(stderr, "Error opening checkpoint '%s': %s\n", filename,
+            strerror(errno));
+    return 0;
+  }
+
+  CheckpointHeader header;
+  if (fread(&header, sizeof(CheckpointHeader), 1, f) != 1 ||
+      header.magic != CHECKPOINT_MAGIC ||
+      header.version != CHECKPOINT_VERSION) {
+    fprintf(stderr, "Error: %s is not a valid checkpoint\n", filename);
+    fclose(f);
+    return 0;
+  }
+
+  if (header.num_users != model->num_users ||
+      header.num_movies != model->num_movies ||
+      header.num_factors != model->num_factors) {
+    fprintf(stderr,
+            "Error: checkpoint shape %dx%dx%d does not match model "
+            "%dx%dx%d\n",
+            header.num_users, header.num_movies, header.num_factors,
+            model->num_users, model->num_movies, model->num_factors);
+    fclose(f);
+    return 0;
+  }
+
+  int ok =
+      fread(model->user_bias, sizeof(float), model->num_users, f) ==
+          (size_t)model->num_users &&
+      fread(model->movie_bias, sizeof(float), model->num_movies, f) ==
+          (size_t)model->num_movies;
+  for (int i = 0; ok && i < model->num_users; i++) {
+    ok = fread(model->user_features[i], sizeof(float), model->num_factors,
+               f) == (size_t)model->num_factors;
+  }
+  for (int i = 0; ok && i < model->num_movies; i++) {
+    ok = fread(model->movie_features[i], sizeof(float), model->num_factors,
+               f) == (size_t)model->num_factors;
+  }
+  fclose(f);
+
+  if (!ok) {
+    fprintf(stderr, "Error: checkpoint %s is truncated\n", filename);
+    return 0;
+  }
+
+  model->global_mean = header.global_mean;
+  model->learning_rate = header.learning_rate;
+  model->regularization = header.regularization;
+  *epoch = header.epoch;
+  *num_ranks = header.num_ranks;
+  return 1;
+}
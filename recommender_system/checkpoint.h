@@ -0,0 +1,14 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "data_structures.h"
+
+typedef struct Checkpointer Checkpointer;
+
+Checkpointer *checkpointer_create(const char *filename, int num_ranks);
+void checkpointer_submit(Checkpointer *checkpointer, Model *model, int epoch);
+void checkpointer_destroy(Checkpointer *checkpointer);
+int load_checkpoint(const char *filename, Model *model, int *epoch,
+                    int *num_ranks);
+
+#endif
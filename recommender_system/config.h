@@ -7,5 +7,30 @@
 #define REGULARIZATION 0.01
 #define NUM_ITERATIONS 50
 #define TRAIN_TEST_SPLIT 0.8
+#define RANDOM_SEED 42ULL
+#define MODEL_FILE "model.bin"
+#define MAPPING_FILE "movie_mapping.bin"
+#define SERVING_FILE "serving_model.bin"
+#define MOVIE_STATS_FILE "movie_stats.bin"
+#define CATALOG_FILE "catalog.bin"
+#define CHECKPOINT_FILE "checkpoint.bin"
+#define ARENA_BLOCK_SIZE (2 * 1024 * 1024)
+#define FOLDIN_REGULARIZATION 0.1f
+#define TOP_K 10
+#define INDEX_FILE "movie_index.bin"
+#define ANN_SUBSPACES 13
+#define ANN_NPROBE 8
+#define ANN_RERANK 200
+#define QUANT_RERANK 100
+#define SERVER_SOCKET "recommend.sock"
+#define SERVER_THREADS 4
+#define SERVER_QUEUE_SIZE 256
+#define SERVER_RELOAD_INTERVAL_MS 500
+#define NEIGHBORS_FILE "movie_neighbors.bin"
+#define NUM_NEIGHBORS 20
+#define SHARD_BATCH 16
+#define POPULARITY_PRIOR 10.0f
+#define EVAL_CUTOFFS "5,10,20"
+#define EVAL_RELEVANCE_THRESHOLD 4.0f
 
 #endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "data_loader.h"
 #include "config.h"
+#include "topk.h"
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,7 +43,13 @@ Dataset *load_dataset(const char *filename, int rank) {
 
   Dataset *dataset = (Dataset *)malloc(sizeof(Dataset));
   dataset->num_ratings = num_ratings;
-  dataset->ratings = (Rating *)malloc(num_ratings * sizeof(Rating));
+  dataset->arena = arena_create(ARENA_BLOCK_SIZE);
+  dataset->ratings =
+      (Rating *)arena_alloc(dataset->arena, num_ratings * sizeof(Rating));
+  if (!dataset->ratings) {
+    fprintf(stderr, "Error: out of memory for %d ratings\n", num_ratings);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
   if (rank == 0) {
     for (int i = 0; i < num_ratings; i++) {
@@ -77,7 +84,7 @@ Dataset *load_dataset(const char *filename, int rank) {
 
 void free_dataset(Dataset *dataset) {
   if (dataset) {
-    free(dataset->ratings);
+    arena_destroy(dataset->arena);
     free(dataset);
   }
 }
@@ -163,12 +170,21 @@ void split_data(Dataset *dataset, Dataset **train, Dataset **test,
   (*train)->num_ratings = train_size;
   (*train)->num_users = dataset->num_users;
   (*train)->num_movies = dataset->num_movies;
-  (*train)->ratings = (Rating *)malloc(train_size * sizeof(Rating));
+  (*train)->arena = arena_create(ARENA_BLOCK_SIZE);
+  (*train)->ratings =
+      (Rating *)arena_alloc((*train)->arena, train_size * sizeof(Rating));
 
   (*test)->num_ratings = test_size;
   (*test)->num_users = dataset->num_users;
   (*test)->num_movies = dataset->num_movies;
-  (*test)->ratings = (Rating *)malloc(test_size * sizeof(Rating));
+  (*test)->arena = arena_create(ARENA_BLOCK_SIZE);
+  (*test)->ratings =
+      (Rating *)arena_alloc((*test)->arena, test_size * sizeof(Rating));
+  if (!(*train)->ratings || !(*test)->ratings) {
+    fprintf(stderr, "Error: out of memory splitting %d ratings\n",
+            dataset->num_ratings);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
   if (rank == 0) {
     for (int i = 0; i < train_size; i++) {
@@ -183,4 +199,40 @@ void split_data(Dataset *dataset, Dataset **train, Dataset **test,
             MPI_COMM_WORLD);
   MPI_Bcast((*test)->ratings, test_size * sizeof(Rating), MPI_BYTE, 0,
             MPI_COMM_WORLD);
-}
\ No newline at end of file
+}
+
+// Only ratings of at least min_rating are listed, so the same builder gives
+// both the seen items to exclude and the relevant items of a test set.
+RatedItems build_rated_items(const Dataset *dataset, float min_rating) {
+  RatedItems rated;
+  rated.offsets = (int *)calloc(dataset->num_users + 1, sizeof(int));
+  rated.movies = (int *)malloc((dataset->num_ratings + 1) * sizeof(int));
+
+  for (int i = 0; i < dataset->num_ratings; i++) {
+    if (dataset->ratings[i].rating >= min_rating)
+      rated.offsets[dataset->ratings[i].user_id + 1]++;
+  }
+  for (int u = 0; u < dataset->num_users; u++) {
+    rated.offsets[u + 1] += rated.offsets[u];
+  }
+
+  int *fill = (int *)malloc((dataset->num_users + 1) * sizeof(int));
+  memcpy(fill, rated.offsets, dataset->num_users * sizeof(int));
+  for (int i = 0; i < dataset->num_ratings; i++) {
+    if (dataset->ratings[i].rating >= min_rating)
+      rated.movies[fill[dataset->ratings[i].user_id]++] =
+          dataset->ratings[i].movie_id;
+  }
+  free(fill);
+
+  for (int u = 0; u < dataset->num_users; u++) {
+    qsort(rated.movies + rated.offsets[u],
+          rated.offsets[u + 1] - rated.offsets[u], sizeof(int), compare_ints);
+  }
+  return rated;
+}
+
+void free_rated_items(RatedItems *rated) {
+  free(rated->offsets);
+  free(rated->movies);
+}
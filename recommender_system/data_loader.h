@@ -3,6 +3,13 @@
 
 #include "data_structures.h"
 
+// CSR list of the movies each (remapped) user rated, sorted per user: user
+// u's movies are movies[offsets[u] .. offsets[u+1]).
+typedef struct {
+  int *offsets;
+  int *movies;
+} RatedItems;
+
 Dataset *load_dataset(const char *filename, int rank);
 void free_dataset(Dataset *dataset);
 IDMapper *create_id_mapper(Dataset *dataset);
@@ -10,5 +17,7 @@ void free_id_mapper(IDMapper *mapper);
 void remap_ids(Dataset *dataset, IDMapper *mapper);
 void split_data(Dataset *dataset, Dataset **train, Dataset **test,
                 float split_ratio, int rank);
+RatedItems build_rated_items(const Dataset *dataset, float min_rating);
+void free_rated_items(RatedItems *rated);
 
 #endif
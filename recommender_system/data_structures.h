@@ -1,6 +1,8 @@
 #ifndef DATA_STRUCTURES_H
 #define DATA_STRUCTURES_H
 
+#include "arena.h"
+
 typedef struct {
   int user_id;
   int movie_id;
@@ -10,6 +12,7 @@ typedef struct {
 
 typedef struct {
   Rating *ratings;
+  Arena *arena;
   int num_ratings;
   int num_users;
   int num_movies;
@@ -20,6 +23,9 @@ typedef struct {
 typedef struct {
   float **user_features;
   float **movie_features;
+  float *user_feature_data;
+  float *movie_feature_data;
+  Arena *arena;
   float *user_bias;
   float *movie_bias;
   float global_mean;
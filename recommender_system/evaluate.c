@@ -0,0 +1,121 @@
+#include "config.h"
+#include "data_loader.h"
+#include "metrics.h"
+#include "model.h"
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Offline evaluation of model.bin on the held-out split train_save used.
+// The split is deterministic, so reloading the ratings file reproduces it.
+int main(int argc, char **argv) {
+  int rank, size;
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  const char *model_file = MODEL_FILE;
+  int cutoffs[METRICS_MAX_CUTOFFS];
+  int num_cutoffs = parse_cutoffs(EVAL_CUTOFFS, cutoffs);
+  float threshold = EVAL_RELEVANCE_THRESHOLD;
+  int bad_args = argc < 2;
+  for (int i = 2; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      num_cutoffs = parse_cutoffs(argv[++i], cutoffs);
+      bad_args = num_cutoffs == 0;
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      threshold = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      model_file = argv[++i];
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args) {
+    if (rank == 0) {
+      printf("Usage: %s <ratings_file.csv> [-k 5,10,20] [-t threshold] "
+             "[-m model.bin]\n",
+             argv[0]);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+
+  double start_time = MPI_Wtime();
+  Model *model = load_model(model_file);
+  if (!model) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  Dataset *dataset = load_dataset(argv[1], rank);
+  IDMapper *mapper = create_id_mapper(dataset);
+  remap_ids(dataset, mapper);
+  if (dataset->num_users != model->num_users ||
+      dataset->num_movies != model->num_movies) {
+    if (rank == 0) {
+      fprintf(stderr,
+              "Error: %s has %d users and %d movies but %s has %d and %d; "
+              "use the file the model was trained on\n",
+              argv[1], dataset->num_users, dataset->num_movies, model_file,
+              model->num_users, model->num_movies);
+    }
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  Dataset *train_data, *test_data;
+  split_data(dataset, &train_data, &test_data, TRAIN_TEST_SPLIT, rank);
+  double load_time = MPI_Wtime() - start_time;
+
+  if (rank == 0) {
+    printf("Evaluating %d test ratings on %d processes x %d threads\n",
+           test_data->num_ratings, size, omp_get_max_threads());
+  }
+
+  double eval_start = MPI_Wtime();
+  ErrorMetrics errors;
+  evaluate_errors(model, test_data, rank, size, &errors);
+  double error_time = MPI_Wtime() - eval_start;
+
+  eval_start = MPI_Wtime();
+  RankingMetrics metrics;
+  evaluate_ranking(model, train_data, test_data, cutoffs, num_cutoffs,
+                   threshold, rank, size, &metrics);
+  double eval_time = MPI_Wtime() - eval_start;
+
+  if (rank == 0) {
+    printf("\nRMSE: %.4f, MAE: %.4f over %lld ratings\n", errors.rmse,
+           errors.mae, errors.count);
+    printf("%6s %10s %10s %10s %10s\n", "Rating", "Count", "RMSE", "MAE",
+           "Bias");
+    for (int b = 0; b < ERROR_BUCKETS; b++) {
+      if (errors.bucket_count[b] == 0)
+        continue;
+      printf("%6.1f %10lld %10.4f %10.4f %+10.4f\n", 0.5 * (b + 1),
+             errors.bucket_count[b], errors.bucket_rmse[b],
+             errors.bucket_mae[b], errors.bucket_bias[b]);
+    }
+
+    printf("\nRanking over %lld users (relevant: rating >= %.1f, training "
+           "items excluded)\n",
+           metrics.num_users, threshold);
+    printf("%6s %10s %10s %10s %10s\n", "K", "Precision", "Recall", "NDCG",
+           "MAP");
+    for (int c = 0; c < metrics.num_cutoffs; c++) {
+      printf("%6d %10.4f %10.4f %10.4f %10.4f\n", metrics.cutoffs[c],
+             metrics.precision[c], metrics.recall[c], metrics.ndcg[c],
+             metrics.map[c]);
+    }
+    printf("\nLoaded in %.2f s, errors in %.3f s, ranked in %.2f s\n",
+           load_time, error_time, eval_time);
+  }
+
+  free_dataset(train_data);
+  free_dataset(test_data);
+  free_id_mapper(mapper);
+  free_dataset(dataset);
+  free_model(model);
+  MPI_Finalize();
+  return 0;
+}
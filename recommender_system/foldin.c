@@ -0,0 +1,202 @@
+#include "foldin.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// In-place Cholesky factorization of the n x n SPD matrix a (row-major, lower
+// triangle used), followed by forward and back substitution for a x = b.
+// The solution overwrites b. Returns 0 if a is not positive definite.
+static int cholesky_solve(double *a, double *b, int n) {
+  for (int j = 0; j < n; j++) {
+    double d = a[j * n + j];
+    for (int p = 0; p < j; p++)
+      d -= a[j * n + p] * a[j * n + p];
+    if (d <= 0.0)
+      return 0;
+    d = sqrt(d);
+    a[j * n + j] = d;
+    for (int i = j + 1; i < n; i++) {
+      double s = a[i * n + j];
+      for (int p = 0; p < j; p++)
+        s -= a[i * n + p] * a[j * n + p];
+      a[i * n + j] = s / d;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    double s = b[i];
+    for (int p = 0; p < i; p++)
+      s -= a[i * n + p] * b[p];
+    b[i] = s / a[i * n + i];
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double s = b[i];
+    for (int p = i + 1; p < n; p++)
+      s -= a[p * n + i] * b[p];
+    b[i] = s / a[i * n + i];
+  }
+  return 1;
+}
+
+// Per-thread buffers for one solve, reused across users: the normal matrix,
+// the right-hand side, and the augmented rating rows with their targets.
+typedef struct {
+  double *a;
+  double *b;
+  double *rows;
+  double *targets;
+} FoldinScratch;
+
+static void scratch_init(FoldinScratch *scratch, int n) {
+  int max_rows = n > FOLDIN_BLOCK ? n : FOLDIN_BLOCK;
+  scratch->a = (double *)malloc((size_t)n * n * sizeof(double));
+  scratch->b = (double *)malloc(n * sizeof(double));
+  scratch->rows = (double *)malloc((size_t)max_rows * n * sizeof(double));
+  scratch->targets = (double *)malloc(max_rows * sizeof(double));
+}
+
+static void scratch_free(FoldinScratch *scratch) {
+  free(scratch->a);
+  free(scratch->b);
+  free(scratch->rows);
+  free(scratch->targets);
+}
+
+// Row t of the augmented design matrix, [v_j 1], and its target
+// r - mu - b_j.
+static void load_row(const Model *model, const UserRating *rating,
+                     double *row, double *target) {
+  int k = model->num_factors;
+  const float *v = model->movie_features[rating->movie_id];
+  for (int i = 0; i < k; i++)
+    row[i] = v[i];
+  row[k] = 1.0;
+  *target = rating->rating - model->global_mean -
+            model->movie_bias[rating->movie_id];
+}
+
+// With fewer ratings r than unknowns n, the same solution comes from the
+// r x r dual system, x = A^T (A A^T + lambda I)^-1 y, which is far cheaper
+// for the short rating lists of new users.
+static int solve_dual(const Model *model, const UserRating *ratings, int r,
+                      double lambda, FoldinScratch *scratch, double *x) {
+  int n = model->num_factors + 1;
+  double *rows = scratch->rows, *alpha = scratch->targets;
+  for (int t = 0; t < r; t++)
+    load_row(model, &ratings[t], rows + (size_t)t * n, &alpha[t]);
+  for (int i = 0; i < r; i++) {
+    for (int j = 0; j <= i; j++) {
+      double s = 0.0;
+      for (int p = 0; p < n; p++)
+        s += rows[i * n + p] * rows[j * n + p];
+      scratch->a[i * r + j] = s;
+    }
+    scratch->a[i * r + i] += lambda;
+  }
+  if (!cholesky_solve(scratch->a, alpha, r))
+    return 0;
+  for (int p = 0; p < n; p++) {
+    double s = 0.0;
+    for (int t = 0; t < r; t++)
+      s += rows[t * n + p] * alpha[t];
+    x[p] = s;
+  }
+  return 1;
+}
+
+// Rank-FOLDIN_BLOCK update of the lower triangle: each entry of a is loaded
+// and stored once per block of ratings rather than once per rating. Unused
+// rows of a partial block are zero.
+static void accumulate_block(FoldinScratch *scratch, int n) {
+  const double *rows = scratch->rows;
+  for (int i = 0; i < n; i++) {
+    double *row = scratch->a + (size_t)i * n;
+#pragma omp simd
+    for (int j = 0; j <= i; j++) {
+      double s = row[j];
+      for (int t = 0; t < FOLDIN_BLOCK; t++)
+        s += rows[t * n + i] * rows[t * n + j];
+      row[j] = s;
+    }
+    double s = scratch->b[i];
+    for (int t = 0; t < FOLDIN_BLOCK; t++)
+      s += rows[t * n + i] * scratch->targets[t];
+    scratch->b[i] = s;
+  }
+}
+
+// Exact ridge-regression fold-in. The user bias is solved jointly with the
+// factors by augmenting every movie vector with a constant 1, giving the
+// (k+1) x (k+1) system (A^T A + lambda n I) x = A^T (r - mu - b_i) with
+// A = [V 1]. The penalty is scaled by the number of ratings so heavy and
+// light raters are shrunk comparably.
+static int solve_user(const Model *model, const UserRating *ratings,
+                      int num_ratings, float regularization,
+                      FoldinScratch *scratch, float *profile, float *bias) {
+  int k = model->num_factors;
+  int n = k + 1;
+  double lambda = (double)regularization * (num_ratings > 0 ? num_ratings : 1);
+  int ok;
+  if (num_ratings < n) {
+    ok = solve_dual(model, ratings, num_ratings, lambda, scratch, scratch->b);
+  } else {
+    memset(scratch->a, 0, (size_t)n * n * sizeof(double));
+    memset(scratch->b, 0, n * sizeof(double));
+    for (int r0 = 0; r0 < num_ratings; r0 += FOLDIN_BLOCK) {
+      for (int t = 0; t < FOLDIN_BLOCK; t++) {
+        double *row = scratch->rows + (size_t)t * n;
+        if (r0 + t < num_ratings) {
+          load_row(model, &ratings[r0 + t], row, &scratch->targets[t]);
+        } else {
+          memset(row, 0, n * sizeof(double));
+          scratch->targets[t] = 0.0;
+        }
+      }
+      accumulate_block(scratch, n);
+    }
+    for (int i = 0; i < n; i++)
+      scratch->a[i * n + i] += lambda;
+    ok = cholesky_solve(scratch->a, scratch->b, n);
+  }
+
+  for (int i = 0; i < k; i++)
+    profile[i] = ok ? (float)scratch->b[i] : 0.0f;
+  *bias = ok ? (float)scratch->b[k] : 0.0f;
+  return ok;
+}
+
+int fold_in_user(const Model *model, const UserRating *ratings,
+                 int num_ratings, float regularization, float *profile,
+                 float *bias) {
+  FoldinScratch scratch;
+  scratch_init(&scratch, model->num_factors + 1);
+  int ok = solve_user(model, ratings, num_ratings, regularization, &scratch,
+                      profile, bias);
+  scratch_free(&scratch);
+  return ok;
+}
+
+// User u's ratings are ratings[offsets[u] .. offsets[u+1]); its profile is
+// written to profiles + u * num_factors. Users are spread over the OpenMP
+// threads, each solving with its own scratch buffers, so no allocation
+// happens per user. Returns the number of users solved; a failed solve
+// leaves a zero profile and bias.
+int fold_in_users(const Model *model, const int *offsets,
+                  const UserRating *ratings, int num_users,
+                  float regularization, float *profiles, float *biases) {
+  int k = model->num_factors;
+  int solved = 0;
+#pragma omp parallel reduction(+ : solved)
+  {
+    FoldinScratch scratch;
+    scratch_init(&scratch, k + 1);
+#pragma omp for schedule(dynamic, 16)
+    for (int u = 0; u < num_users; u++) {
+      solved += solve_user(model, ratings + offsets[u],
+                           offsets[u + 1] - offsets[u], regularization,
+                           &scratch, profiles + (size_t)u * k, &biases[u]);
+    }
+    scratch_free(&scratch);
+  }
+  return solved;
+}
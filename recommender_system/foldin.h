@@ -0,0 +1,20 @@
+#ifndef FOLDIN_H
+#define FOLDIN_H
+
+#include "data_structures.h"
+
+#define FOLDIN_BLOCK 8
+
+typedef struct {
+  int movie_id;
+  float rating;
+} UserRating;
+
+int fold_in_user(const Model *model, const UserRating *ratings,
+                 int num_ratings, float regularization, float *profile,
+                 float *bias);
+int fold_in_users(const Model *model, const int *offsets,
+                  const UserRating *ratings, int num_users,
+                  float regularization, float *profiles, float *biases);
+
+#endif
@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "config.h"
+#include "model.h"
+#include "movies.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <omp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *socket_path;
+  int port;
+  const int *movie_ids;
+  int num_movies;
+  int num_requests;
+  int ratings_per_request;
+  int top_k;
+  unsigned long long seed;
+  double *latencies;
+  int completed;
+  int errors;
+} Client;
+
+static int connect_server(const char *socket_path, int port) {
+  int fd;
+  if (port > 0) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  } else {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+// Each client keeps one connection open and issues requests back to back,
+// timing each one from the first byte sent to the end of the response line.
+static void *run_client(void *arg) {
+  Client *client = (Client *)arg;
+  int fd = connect_server(client->socket_path, client->port);
+  if (fd < 0) {
+    fprintf(stderr, "Error connecting: %s\n", strerror(errno));
+    return NULL;
+  }
+  FILE *in = fdopen(fd, "r");
+  size_t request_cap = 32 + (size_t)client->ratings_per_request * 24;
+  char *request = (char *)malloc(request_cap);
+  char *line = NULL;
+  size_t line_cap = 0;
+  uint64_t state = client->seed;
+
+  for (int r = 0; r < client->num_requests; r++) {
+    int len = sprintf(request, "REC %d", client->top_k);
+    for (int i = 0; i < client->ratings_per_request; i++) {
+      state = splitmix64(state);
+      int movie = client->movie_ids[state % client->num_movies];
+      float rating = 0.5f * (1 + (int)((state >> 32) % 10));
+      len += sprintf(request + len, " %d:%.1f", movie, rating);
+    }
+    request[len++] = '\n';
+
+    double start = omp_get_wtime();
+    if (write(fd, request, len) != len ||
+        getline(&line, &line_cap, in) <= 0)
+      break;
+    client->latencies[client->completed++] = omp_get_wtime() - start;
+    if (strncmp(line, "OK", 2) != 0)
+      client->errors++;
+  }
+
+  free(line);
+  free(request);
+  fclose(in);
+  return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+  const char *socket_path = SERVER_SOCKET;
+  int port = 0;
+  int num_clients = 4;
+  int num_requests = 1000;
+  int ratings_per_request = 10;
+  int top_k = TOP_K;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      num_clients = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      num_requests = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      ratings_per_request = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      top_k = atoi(argv[++i]);
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_clients <= 0 || num_requests <= 0 ||
+      ratings_per_request <= 0 || top_k <= 0) {
+    printf("Usage: %s [-s socket | --tcp port] [-c clients] "
+           "[-n requests per client] [-r ratings per request] [-k K]\n",
+           argv[0]);
+    return 1;
+  }
+
+  int num_movies;
+  int *movie_ids = load_movie_mapping("movie_mapping.bin", &num_movies);
+  if (!movie_ids)
+    return 1;
+
+  Client *clients = (Client *)calloc(num_clients, sizeof(Client));
+  pthread_t *threads = (pthread_t *)malloc(num_clients * sizeof(pthread_t));
+  double *latencies =
+      (double *)malloc((size_t)num_clients * num_requests * sizeof(double));
+  double start = omp_get_wtime();
+  for (int c = 0; c < num_clients; c++) {
+    clients[c].socket_path = socket_path;
+    clients[c].port = port;
+    clients[c].movie_ids = movie_ids;
+    clients[c].num_movies = num_movies;
+    clients[c].num_requests = num_requests;
+    clients[c].ratings_per_request = ratings_per_request;
+    clients[c].top_k = top_k;
+    clients[c].seed = RANDOM_SEED + c;
+    clients[c].latencies = latencies + (size_t)c * num_requests;
+    pthread_create(&threads[c], NULL, run_client, &clients[c]);
+  }
+
+  long long total = 0;
+  int errors = 0;
+  for (int c = 0; c < num_clients; c++) {
+    pthread_join(threads[c], NULL);
+    memmove(latencies + total, clients[c].latencies,
+            clients[c].completed * sizeof(double));
+    total += clients[c].completed;
+    errors += clients[c].errors;
+  }
+  double elapsed = omp_get_wtime() - start;
+
+  if (total == 0) {
+    fprintf(stderr, "No requests completed\n");
+    return 1;
+  }
+  qsort(latencies, total, sizeof(double), compare_doubles);
+  printf("%lld requests from %d clients in %.2f s (%d errors)\n", total,
+         num_clients, elapsed, errors);
+  printf("QPS: %.0f\n", total / elapsed);
+  printf("Latency p50: %.3f ms, p99: %.3f ms, max: %.3f ms\n",
+         1e3 * latencies[total / 2], 1e3 * latencies[total * 99 / 100],
+         1e3 * latencies[total - 1]);
+
+  free(latencies);
+  free(threads);
+  free(clients);
+  free(movie_ids);
+  return errors == 0 && total == (long long)num_clients * num_requests ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+#include "metrics.h"
+#include "data_loader.h"
+#include "model_io.h"
+#include "score.h"
+#include "topk.h"
+#include <math.h>
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compensated (Kahan) summation: the rounding error of each addition is
+// carried into the next, so the total stays accurate to a few ulps however
+// many millions of terms are added.
+typedef struct {
+  double sum;
+  double carry;
+} KahanSum;
+
+static inline void kahan_add(KahanSum *acc, double value) {
+  double y = value - acc->carry;
+  double t = acc->sum + y;
+  acc->carry = (t - acc->sum) - y;
+  acc->sum = t;
+}
+
+static int rating_bucket(float rating) {
+  int bucket = (int)(rating * 2.0f + 0.5f) - 1;
+  return bucket < 0 ? 0 : (bucket >= ERROR_BUCKETS ? ERROR_BUCKETS - 1
+                                                    : bucket);
+}
+
+// RMSE, MAE and per-bucket errors in one pass. Each rank takes a contiguous
+// range of the test set and its OpenMP threads predict from the flat factor
+// rows with a SIMD dot product, accumulating in compensated doubles. Thread
+// totals are combined, then a single Allreduce gives every rank the result.
+void evaluate_errors(const Model *model, const Dataset *test, int rank,
+                     int size, ErrorMetrics *metrics) {
+  int local_start, local_end;
+  owned_range(test->num_ratings, rank, size, &local_start, &local_end);
+  int k = model->num_factors;
+
+  // Per bucket: count, squared error, absolute error, signed error.
+  double totals[4 * ERROR_BUCKETS] = {0.0};
+
+#pragma omp parallel
+  {
+    KahanSum squared[ERROR_BUCKETS], absolute[ERROR_BUCKETS],
+        signed_error[ERROR_BUCKETS];
+    long long counts[ERROR_BUCKETS] = {0};
+    memset(squared, 0, sizeof(squared));
+    memset(absolute, 0, sizeof(absolute));
+    memset(signed_error, 0, sizeof(signed_error));
+
+#pragma omp for schedule(static)
+    for (int i = local_start; i < local_end; i++) {
+      const Rating *rating = &test->ratings[i];
+      const float *p = model->user_feature_data + (size_t)rating->user_id * k;
+      const float *q =
+          model->movie_feature_data + (size_t)rating->movie_id * k;
+      float dot = 0.0f;
+#pragma omp simd reduction(+ : dot)
+      for (int f = 0; f < k; f++)
+        dot += p[f] * q[f];
+      float prediction = model->global_mean +
+                         model->user_bias[rating->user_id] +
+                         model->movie_bias[rating->movie_id] + dot;
+      if (prediction > 5.0f)
+        prediction = 5.0f;
+      if (prediction < 0.5f)
+        prediction = 0.5f;
+
+      double error = (double)prediction - rating->rating;
+      int b = rating_bucket(rating->rating);
+      counts[b]++;
+      kahan_add(&squared[b], error * error);
+      kahan_add(&absolute[b], fabs(error));
+      kahan_add(&signed_error[b], error);
+    }
+
+#pragma omp critical
+    for (int b = 0; b < ERROR_BUCKETS; b++) {
+      totals[b] += counts[b];
+      totals[ERROR_BUCKETS + b] += squared[b].sum - squared[b].carry;
+      totals[2 * ERROR_BUCKETS + b] += absolute[b].sum - absolute[b].carry;
+      totals[3 * ERROR_BUCKETS + b] +=
+          signed_error[b].sum - signed_error[b].carry;
+    }
+  }
+
+  MPI_Allreduce(MPI_IN_PLACE, totals, 4 * ERROR_BUCKETS, MPI_DOUBLE, MPI_SUM,
+                MPI_COMM_WORLD);
+
+  KahanSum squared_total = {0.0, 0.0}, absolute_total = {0.0, 0.0};
+  long long count = 0;
+  for (int b = 0; b < ERROR_BUCKETS; b++) {
+    long long n = (long long)totals[b];
+    double scale = n > 0 ? 1.0 / n : 0.0;
+    metrics->bucket_count[b] = n;
+    metrics->bucket_rmse[b] = sqrt(totals[ERROR_BUCKETS + b] * scale);
+    metrics->bucket_mae[b] = totals[2 * ERROR_BUCKETS + b] * scale;
+    metrics->bucket_bias[b] = totals[3 * ERROR_BUCKETS + b] * scale;
+    count += n;
+    kahan_add(&squared_total, totals[ERROR_BUCKETS + b]);
+    kahan_add(&absolute_total, totals[2 * ERROR_BUCKETS + b]);
+  }
+  metrics->count = count;
+  metrics->rmse = count > 0 ? sqrt(squared_total.sum / count) : 0.0;
+  metrics->mae = count > 0 ? absolute_total.sum / count : 0.0;
+}
+
+// Parses a comma-separated list such as "5,10,20" into ascending cutoffs.
+// Returns the number parsed, or 0 if the list is malformed.
+int parse_cutoffs(const char *list, int *cutoffs) {
+  int count = 0;
+  const char *cursor = list;
+  while (*cursor) {
+    char *end;
+    long k = strtol(cursor, &end, 10);
+    if (end == cursor || k <= 0 || count == METRICS_MAX_CUTOFFS)
+      return 0;
+    cutoffs[count++] = (int)k;
+    cursor = end;
+    if (*cursor == ',')
+      cursor++;
+    else if (*cursor)
+      return 0;
+  }
+  qsort(cutoffs, count, sizeof(int), compare_ints);
+  return count;
+}
+
+static int is_relevant(const int *items, int count, int movie) {
+  int lo = 0, hi = count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (items[mid] < movie)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < count && items[lo] == movie;
+}
+
+// Adds one user's precision, recall, NDCG and average precision at every
+// cutoff to sums, laid out as four blocks of num_cutoffs. Gains are binary;
+// ideal_dcg[i] is the DCG of i leading hits.
+static void accumulate_user(const TopK *topk, const int *relevant,
+                            int num_relevant, const int *cutoffs,
+                            int num_cutoffs, const double *ideal_dcg,
+                            double *sums) {
+  int hits = 0, c = 0;
+  double dcg = 0.0, precision_sum = 0.0;
+  int max_k = cutoffs[num_cutoffs - 1];
+  for (int r = 0; r < max_k && c < num_cutoffs; r++) {
+    if (r < topk->size &&
+        is_relevant(relevant, num_relevant, topk->items[r].id)) {
+      hits++;
+      dcg += 1.0 / log2(r + 2.0);
+      precision_sum += (double)hits / (r + 1);
+    }
+    while (c < num_cutoffs && cutoffs[c] == r + 1) {
+      int k = cutoffs[c];
+      int ideal = num_relevant < k ? num_relevant : k;
+      sums[c] += (double)hits / k;
+      sums[num_cutoffs + c] += (double)hits / num_relevant;
+      sums[2 * num_cutoffs + c] += dcg / ideal_dcg[ideal];
+      sums[3 * num_cutoffs + c] += precision_sum / ideal;
+      c++;
+    }
+  }
+}
+
+// Ranks the whole catalog for every test user with a relevant item (rating
+// of at least relevance_threshold), excluding the movies they rated in
+// training, and averages the top-K metrics. Users are split evenly across
+// ranks and scored in panels of SCORE_USER_PANEL by the blocked kernel on
+// each rank's OpenMP threads; one Allreduce combines the sums. Cutoffs must
+// be ascending. Collective; every rank receives the result.
+void evaluate_ranking(const Model *model, const Dataset *train,
+                      const Dataset *test, const int *cutoffs,
+                      int num_cutoffs, float relevance_threshold, int rank,
+                      int size, RankingMetrics *metrics) {
+  RatedItems seen = build_rated_items(train, 0.0f);
+  RatedItems relevant = build_rated_items(test, relevance_threshold);
+
+  int *users = (int *)malloc((model->num_users + 1) * sizeof(int));
+  int num_users = 0;
+  for (int u = 0; u < model->num_users; u++) {
+    if (relevant.offsets[u + 1] > relevant.offsets[u])
+      users[num_users++] = u;
+  }
+  int local_start, local_end;
+  owned_range(num_users, rank, size, &local_start, &local_end);
+
+  int max_k = cutoffs[num_cutoffs - 1];
+  int kept = max_k < model->num_movies ? max_k : model->num_movies;
+  double *ideal_dcg = (double *)malloc((max_k + 1) * sizeof(double));
+  ideal_dcg[0] = 1.0;
+  double running = 0.0;
+  for (int i = 1; i <= max_k; i++) {
+    running += 1.0 / log2(i + 1.0);
+    ideal_dcg[i] = running;
+  }
+
+  ScoreCatalog *catalog =
+      score_catalog_create(model->movie_feature_data, model->movie_bias,
+                           model->global_mean, model->num_movies,
+                           model->num_factors);
+  int num_sums = 4 * num_cutoffs;
+  double sums[4 * METRICS_MAX_CUTOFFS + 1] = {0.0};
+
+#pragma omp parallel
+  {
+    double local[4 * METRICS_MAX_CUTOFFS] = {0.0};
+    Candidate *storage = (Candidate *)malloc((size_t)SCORE_USER_PANEL *
+                                             (kept + 1) * sizeof(Candidate));
+    TopK topks[SCORE_USER_PANEL];
+    ScoreRequest requests[SCORE_USER_PANEL];
+    memset(requests, 0, sizeof(requests));
+
+#pragma omp for schedule(dynamic)
+    for (int i0 = local_start; i0 < local_end; i0 += SCORE_USER_PANEL) {
+      int n = local_end - i0 < SCORE_USER_PANEL ? local_end - i0
+                                                : SCORE_USER_PANEL;
+      for (int b = 0; b < n; b++) {
+        int user = users[i0 + b];
+        topk_init(&topks[b], storage + (size_t)b * (kept + 1), kept);
+        requests[b].profile = model->user_features[user];
+        requests[b].bias = model->user_bias[user];
+        requests[b].excluded = seen.movies + seen.offsets[user];
+        requests[b].num_excluded = seen.offsets[user + 1] - seen.offsets[user];
+        requests[b].topk = &topks[b];
+      }
+
+      score_topk_batch(catalog, requests, n);
+
+      for (int b = 0; b < n; b++) {
+        int user = users[i0 + b];
+        accumulate_user(&topks[b], relevant.movies + relevant.offsets[user],
+                        relevant.offsets[user + 1] - relevant.offsets[user],
+                        cutoffs, num_cutoffs, ideal_dcg, local);
+      }
+    }
+
+#pragma omp critical
+    for (int i = 0; i < num_sums; i++)
+      sums[i] += local[i];
+    free(storage);
+  }
+
+  // The user count rides along with the sums so one collective suffices.
+  sums[num_sums] = local_end - local_start;
+  MPI_Allreduce(MPI_IN_PLACE, sums, num_sums + 1, MPI_DOUBLE, MPI_SUM,
+                MPI_COMM_WORLD);
+
+  long long total_users = (long long)sums[num_sums];
+  double scale = total_users > 0 ? 1.0 / total_users : 0.0;
+  metrics->num_cutoffs = num_cutoffs;
+  metrics->num_users = total_users;
+  for (int c = 0; c < num_cutoffs; c++) {
+    metrics->cutoffs[c] = cutoffs[c];
+    metrics->precision[c] = sums[c] * scale;
+    metrics->recall[c] = sums[num_cutoffs + c] * scale;
+    metrics->ndcg[c] = sums[2 * num_cutoffs + c] * scale;
+    metrics->map[c] = sums[3 * num_cutoffs + c] * scale;
+  }
+
+  score_catalog_free(catalog);
+  free(ideal_dcg);
+  free(users);
+  free_rated_items(&seen);
+  free_rated_items(&relevant);
+}
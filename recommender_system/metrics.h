@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "data_structures.h"
+
+#define METRICS_MAX_CUTOFFS 8
+#define ERROR_BUCKETS 10
+
+// Prediction error over a test set. Bucket b holds the test ratings of
+// (b + 1) / 2 stars; its bias is the mean of predicted minus actual.
+typedef struct {
+  long long count;
+  double rmse;
+  double mae;
+  long long bucket_count[ERROR_BUCKETS];
+  double bucket_rmse[ERROR_BUCKETS];
+  double bucket_mae[ERROR_BUCKETS];
+  double bucket_bias[ERROR_BUCKETS];
+} ErrorMetrics;
+
+// Top-K quality averaged over every test user with at least one relevant
+// item. Entry c of each array is measured at cutoffs[c].
+typedef struct {
+  int num_cutoffs;
+  int cutoffs[METRICS_MAX_CUTOFFS];
+  double precision[METRICS_MAX_CUTOFFS];
+  double recall[METRICS_MAX_CUTOFFS];
+  double ndcg[METRICS_MAX_CUTOFFS];
+  double map[METRICS_MAX_CUTOFFS];
+  long long num_users;
+} RankingMetrics;
+
+void evaluate_errors(const Model *model, const Dataset *test, int rank,
+                     int size, ErrorMetrics *metrics);
+int parse_cutoffs(const char *list, int *cutoffs);
+void evaluate_ranking(const Model *model, const Dataset *train,
+                      const Dataset *test, const int *cutoffs,
+                      int num_cutoffs, float relevance_threshold, int rank,
+                      int size, RankingMetrics *metrics);
+
+#endif
@@ -0,0 +1,351 @@
+#include "mips_index.h"
+#include "model.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIPS_INDEX_MAGIC 0x5846564d
+#define KMEANS_ITERATIONS 12
+#define KMEANS_SAMPLES_PER_CENTROID 64
+
+static float squared_distance(const float *a, const float *b, int d) {
+  float s = 0.0f;
+  for (int i = 0; i < d; i++) {
+    float diff = a[i] - b[i];
+    s += diff * diff;
+  }
+  return s;
+}
+
+static float dot(const float *a, const float *b, int d) {
+  float s = 0.0f;
+  for (int i = 0; i < d; i++)
+    s += a[i] * b[i];
+  return s;
+}
+
+static int nearest_centroid(const float *x, const float *centroids, int k,
+                            int d) {
+  int best = 0;
+  float best_dist = squared_distance(x, centroids, d);
+  for (int c = 1; c < k; c++) {
+    float dist = squared_distance(x, centroids + (size_t)c * d, d);
+    if (dist < best_dist) {
+      best_dist = dist;
+      best = c;
+    }
+  }
+  return best;
+}
+
+// Lloyd's k-means on a seeded sample of at most KMEANS_SAMPLES_PER_CENTROID
+// points per centroid, followed by one assignment pass over all n points.
+static void kmeans(const float *data, int n, int d, int k, uint64_t seed,
+                   float *centroids, int *assign) {
+  int *perm = (int *)malloc(n * sizeof(int));
+  for (int i = 0; i < n; i++)
+    perm[i] = i;
+  int sample = (long long)k * KMEANS_SAMPLES_PER_CENTROID < n
+                   ? k * KMEANS_SAMPLES_PER_CENTROID
+                   : n;
+  for (int i = 0; i < sample; i++) {
+    int j = i + (int)(splitmix64(seed + i) % (uint64_t)(n - i));
+    int tmp = perm[i];
+    perm[i] = perm[j];
+    perm[j] = tmp;
+  }
+  for (int c = 0; c < k; c++) {
+    memcpy(centroids + (size_t)c * d, data + (size_t)perm[c] * d,
+           d * sizeof(float));
+  }
+
+  int *sample_assign = (int *)malloc(sample * sizeof(int));
+  double *sums = (double *)malloc((size_t)k * d * sizeof(double));
+  int *counts = (int *)malloc(k * sizeof(int));
+
+  for (int iter = 0; iter < KMEANS_ITERATIONS; iter++) {
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < sample; i++) {
+      sample_assign[i] =
+          nearest_centroid(data + (size_t)perm[i] * d, centroids, k, d);
+    }
+
+    memset(sums, 0, (size_t)k * d * sizeof(double));
+    memset(counts, 0, k * sizeof(int));
+    for (int i = 0; i < sample; i++) {
+      const float *x = data + (size_t)perm[i] * d;
+      double *sum = sums + (size_t)sample_assign[i] * d;
+      for (int t = 0; t < d; t++)
+        sum[t] += x[t];
+      counts[sample_assign[i]]++;
+    }
+    for (int c = 0; c < k; c++) {
+      float *centroid = centroids + (size_t)c * d;
+      if (counts[c] == 0) {
+        int i = perm[splitmix64(seed ^ ((uint64_t)iter << 32) ^ c) % sample];
+        memcpy(centroid, data + (size_t)i * d, d * sizeof(float));
+        continue;
+      }
+      for (int t = 0; t < d; t++)
+        centroid[t] = (float)(sums[(size_t)c * d + t] / counts[c]);
+    }
+  }
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; i++) {
+    assign[i] = nearest_centroid(data + (size_t)i * d, centroids, k, d);
+  }
+
+  free(perm);
+  free(sample_assign);
+  free(sums);
+  free(counts);
+}
+
+MipsIndex *mips_index_build(const Model *model, int num_lists,
+                            int num_subspaces, unsigned long long seed) {
+  int n = model->num_movies;
+  int k = model->num_factors;
+  if (num_lists > n)
+    num_lists = n;
+
+  MipsIndex *index = (MipsIndex *)calloc(1, sizeof(MipsIndex));
+  index->num_movies = n;
+  index->num_factors = k;
+  index->num_lists = num_lists;
+  index->num_subspaces = num_subspaces;
+  index->sub_dim = (k + 2 + num_subspaces - 1) / num_subspaces;
+  index->dim = index->sub_dim * num_subspaces;
+  index->num_codewords = n < 256 ? n : 256;
+  int d = index->dim;
+
+  // x' = [v, b, sqrt(M^2 - |v|^2 - b^2), 0...]: every augmented vector has
+  // norm M, so for q' = [p, 1, 0...] the largest q'.x' is the nearest x'.
+  float max_norm2 = 0.0f;
+  for (int j = 0; j < n; j++) {
+    const float *v = model->movie_features[j];
+    float norm2 = dot(v, v, k) + model->movie_bias[j] * model->movie_bias[j];
+    if (norm2 > max_norm2)
+      max_norm2 = norm2;
+  }
+  index->max_norm = sqrtf(max_norm2);
+
+  float *augmented = (float *)calloc((size_t)n * d, sizeof(float));
+  for (int j = 0; j < n; j++) {
+    float *x = augmented + (size_t)j * d;
+    const float *v = model->movie_features[j];
+    memcpy(x, v, k * sizeof(float));
+    x[k] = model->movie_bias[j];
+    float rest = max_norm2 - dot(x, x, k + 1);
+    x[k + 1] = rest > 0.0f ? sqrtf(rest) : 0.0f;
+  }
+
+  index->centroids = (float *)malloc((size_t)num_lists * d * sizeof(float));
+  int *assign = (int *)malloc(n * sizeof(int));
+  kmeans(augmented, n, d, num_lists, seed, index->centroids, assign);
+
+  index->list_offsets = (int *)calloc(num_lists + 1, sizeof(int));
+  index->list_ids = (int *)malloc(n * sizeof(int));
+  for (int j = 0; j < n; j++)
+    index->list_offsets[assign[j] + 1]++;
+  for (int c = 0; c < num_lists; c++)
+    index->list_offsets[c + 1] += index->list_offsets[c];
+  int *fill = (int *)malloc(num_lists * sizeof(int));
+  memcpy(fill, index->list_offsets, num_lists * sizeof(int));
+  for (int j = 0; j < n; j++)
+    index->list_ids[fill[assign[j]]++] = j;
+  free(fill);
+
+  // Residuals in list order, so codes for one list are contiguous.
+  float *residuals = (float *)malloc((size_t)n * d * sizeof(float));
+  for (int pos = 0; pos < n; pos++) {
+    int j = index->list_ids[pos];
+    const float *c = index->centroids + (size_t)assign[j] * d;
+    for (int t = 0; t < d; t++)
+      residuals[(size_t)pos * d + t] = augmented[(size_t)j * d + t] - c[t];
+  }
+
+  int m = num_subspaces, sd = index->sub_dim, ncw = index->num_codewords;
+  index->codebooks = (float *)malloc((size_t)m * ncw * sd * sizeof(float));
+  index->codes = (unsigned char *)malloc((size_t)n * m);
+  float *sub = (float *)malloc((size_t)n * sd * sizeof(float));
+  int *sub_assign = (int *)malloc(n * sizeof(int));
+  for (int s = 0; s < m; s++) {
+    for (int pos = 0; pos < n; pos++) {
+      memcpy(sub + (size_t)pos * sd, residuals + (size_t)pos * d + s * sd,
+             sd * sizeof(float));
+    }
+    kmeans(sub, n, sd, ncw, seed + 1 + s,
+           index->codebooks + (size_t)s * ncw * sd, sub_assign);
+    for (int pos = 0; pos < n; pos++)
+      index->codes[(size_t)pos * m + s] = (unsigned char)sub_assign[pos];
+  }
+
+  free(sub);
+  free(sub_assign);
+  free(residuals);
+  free(assign);
+  free(augmented);
+  return index;
+}
+
+int mips_index_save(const MipsIndex *index, const char *filename) {
+  FILE *f = fopen(filename, "wb");
+  if (!f) {
+    fprintf(stderr, "Error saving index to %s: %s\n", filename,
+            strerror(errno));
+    return 0;
+  }
+  int header[8] = {MIPS_INDEX_MAGIC,     index->num_movies,
+                   index->num_factors,   index->dim,
+                   index->num_lists,     index->num_subspaces,
+                   index->sub_dim,       index->num_codewords};
+  size_t n = index->num_movies, m = index->num_subspaces;
+  int ok =
+      fwrite(header, sizeof(int), 8, f) == 8 &&
+      fwrite(&index->max_norm, sizeof(float), 1, f) == 1 &&
+      fwrite(index->centroids, sizeof(float),
+             (size_t)index->num_lists * index->dim,
+             f) == (size_t)index->num_lists * index->dim &&
+      fwrite(index->list_offsets, sizeof(int), index->num_lists + 1, f) ==
+          (size_t)index->num_lists + 1 &&
+      fwrite(index->list_ids, sizeof(int), n, f) == n &&
+      fwrite(index->codes, 1, n * m, f) == n * m &&
+      fwrite(index->codebooks, sizeof(float),
+             m * index->num_codewords * index->sub_dim,
+             f) == m * index->num_codewords * index->sub_dim;
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "Error writing index to %s\n", filename);
+    return 0;
+  }
+  return 1;
+}
+
+MipsIndex *mips_index_load(const char *filename) {
+  FILE *f = fopen(filename, "rb");
+  if (!f)
+    return NULL;
+
+  int header[8];
+  MipsIndex *index = (MipsIndex *)calloc(1, sizeof(MipsIndex));
+  if (fread(header, sizeof(int), 8, f) != 8 || header[0] != MIPS_INDEX_MAGIC ||
+      fread(&index->max_norm, sizeof(float), 1, f) != 1) {
+    fprintf(stderr, "Error: %s is not a valid index file\n", filename);
+    free(index);
+    fclose(f);
+    return NULL;
+  }
+  index->num_movies = header[1];
+  index->num_factors = header[2];
+  index->dim = header[3];
+  index->num_lists = header[4];
+  index->num_subspaces = header[5];
+  index->sub_dim = header[6];
+  index->num_codewords = header[7];
+
+  size_t n = index->num_movies, m = index->num_subspaces;
+  size_t centroid_len = (size_t)index->num_lists * index->dim;
+  size_t codebook_len = m * index->num_codewords * index->sub_dim;
+  index->centroids = (float *)malloc(centroid_len * sizeof(float));
+  index->list_offsets = (int *)malloc((index->num_lists + 1) * sizeof(int));
+  index->list_ids = (int *)malloc(n * sizeof(int));
+  index->codes = (unsigned char *)malloc(n * m);
+  index->codebooks = (float *)malloc(codebook_len * sizeof(float));
+
+  int ok = fread(index->centroids, sizeof(float), centroid_len, f) ==
+               centroid_len &&
+           fread(index->list_offsets, sizeof(int), index->num_lists + 1, f) ==
+               (size_t)index->num_lists + 1 &&
+           fread(index->list_ids, sizeof(int), n, f) == n &&
+           fread(index->codes, 1, n * m, f) == n * m &&
+           fread(index->codebooks, sizeof(float), codebook_len, f) ==
+               codebook_len;
+  fclose(f);
+  if (!ok) {
+    fprintf(stderr, "Error: index file %s is truncated\n", filename);
+    mips_index_free(index);
+    return NULL;
+  }
+  return index;
+}
+
+void mips_index_free(MipsIndex *index) {
+  if (index) {
+    free(index->centroids);
+    free(index->list_offsets);
+    free(index->list_ids);
+    free(index->codes);
+    free(index->codebooks);
+    free(index);
+  }
+}
+
+// Probes the nprobe lists whose centroids score highest, ranks their movies
+// by the asymmetric PQ estimate q'.c + sum_s LUT[s][code_s], and rescores the
+// best `rerank` estimates exactly with the fp32 factors.
+void mips_index_search(const MipsIndex *index, const Model *model,
+                       const float *profile, float bias, const int *excluded,
+                       int num_excluded, int nprobe, int rerank, TopK *topk) {
+  int d = index->dim, k = index->num_factors;
+  int m = index->num_subspaces, sd = index->sub_dim;
+  int ncw = index->num_codewords;
+  if (nprobe > index->num_lists)
+    nprobe = index->num_lists;
+  if (rerank < topk->capacity)
+    rerank = topk->capacity;
+
+  float *query = (float *)calloc(d, sizeof(float));
+  memcpy(query, profile, k * sizeof(float));
+  query[k] = 1.0f;
+
+  Candidate *probe_items = (Candidate *)malloc(nprobe * sizeof(Candidate));
+  TopK probes;
+  topk_init(&probes, probe_items, nprobe);
+  for (int c = 0; c < index->num_lists; c++) {
+    topk_push(&probes, dot(query, index->centroids + (size_t)c * d, d), c);
+  }
+
+  float *lut = (float *)malloc((size_t)m * ncw * sizeof(float));
+  for (int s = 0; s < m; s++) {
+    const float *book = index->codebooks + (size_t)s * ncw * sd;
+    for (int w = 0; w < ncw; w++)
+      lut[s * ncw + w] = dot(query + s * sd, book + (size_t)w * sd, sd);
+  }
+
+  Candidate *shortlist_items = (Candidate *)malloc(rerank * sizeof(Candidate));
+  TopK shortlist;
+  topk_init(&shortlist, shortlist_items, rerank);
+  for (int p = 0; p < probes.size; p++) {
+    int list = probes.items[p].id;
+    float base = probes.items[p].score;
+    for (int pos = index->list_offsets[list];
+         pos < index->list_offsets[list + 1]; pos++) {
+      int j = index->list_ids[pos];
+      if (num_excluded > 0 &&
+          bsearch(&j, excluded, num_excluded, sizeof(int), compare_ints))
+        continue;
+      const unsigned char *code = index->codes + (size_t)pos * m;
+      float estimate = base;
+      for (int s = 0; s < m; s++)
+        estimate += lut[s * ncw + code[s]];
+      topk_push(&shortlist, estimate, j);
+    }
+  }
+
+  topk->size = 0;
+  float base = model->global_mean + bias;
+  for (int i = 0; i < shortlist.size; i++) {
+    int j = shortlist.items[i].id;
+    float score = base + model->movie_bias[j] +
+                  dot(profile, model->movie_features[j], k);
+    topk_push(topk, score, j);
+  }
+  topk_sort(topk);
+
+  free(query);
+  free(probe_items);
+  free(lut);
+  free(shortlist_items);
+}
@@ -0,0 +1,36 @@
+#ifndef MIPS_INDEX_H
+#define MIPS_INDEX_H
+
+#include "data_structures.h"
+#include "topk.h"
+
+// IVF-PQ index for maximum inner product search over movie factors. Movie
+// vectors are augmented with their bias and a norm-completing coordinate so
+// that inner-product ranking becomes Euclidean nearest-neighbour ranking,
+// which is what the k-means coarse quantizer and product quantizer assume.
+typedef struct {
+  int num_movies;
+  int num_factors;
+  int dim;
+  int num_lists;
+  int num_subspaces;
+  int sub_dim;
+  int num_codewords;
+  float max_norm;
+  float *centroids;
+  int *list_offsets;
+  int *list_ids;
+  unsigned char *codes;
+  float *codebooks;
+} MipsIndex;
+
+MipsIndex *mips_index_build(const Model *model, int num_lists,
+                            int num_subspaces, unsigned long long seed);
+int mips_index_save(const MipsIndex *index, const char *filename);
+MipsIndex *mips_index_load(const char *filename);
+void mips_index_free(MipsIndex *index);
+void mips_index_search(const MipsIndex *index, const Model *model,
+                       const float *profile, float bias, const int *excluded,
+                       int num_excluded, int nprobe, int rerank, TopK *topk);
+
+#endif
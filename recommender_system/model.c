@@ -1,14 +1,17 @@
 #include "model.h"
+#include "config.h"
+#include "quantize.h"
 #include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 Model *create_model(int num_users, int num_movies, int num_factors,
                     float learning_rate, float regularization) {
   Model *model = (Model *)malloc(sizeof(Model));
+  if (!model)
+    return NULL;
   model->num_users = num_users;
   model->num_movies = num_movies;
   model->num_factors = num_factors;
@@ -16,53 +19,76 @@ Model *create_model(int num_users, int num_movies, int num_factors,
   model->regularization = regularization;
   model->global_mean = 0.0f;
 
-  model->user_features = (float **)malloc(num_users * sizeof(float *));
-  for (int i = 0; i < num_users; i++) {
-    model->user_features[i] = (float *)malloc(num_factors * sizeof(float));
+  size_t row_bytes = num_factors * sizeof(float);
+  model->arena = arena_create(ARENA_BLOCK_SIZE);
+  if (!model->arena) {
+    free(model);
+    return NULL;
+  }
+  model->user_feature_data =
+      (float *)arena_alloc(model->arena, num_users * row_bytes);
+  model->movie_feature_data =
+      (float *)arena_alloc(model->arena, num_movies * row_bytes);
+  model->user_features =
+      (float **)arena_alloc(model->arena, num_users * sizeof(float *));
+  model->movie_features =
+      (float **)arena_alloc(model->arena, num_movies * sizeof(float *));
+  model->user_bias =
+      (float *)arena_alloc(model->arena, num_users * sizeof(float));
+  model->movie_bias =
+      (float *)arena_alloc(model->arena, num_movies * sizeof(float));
+  if (!model->user_feature_data || !model->movie_feature_data ||
+      !model->user_features || !model->movie_features || !model->user_bias ||
+      !model->movie_bias) {
+    free_model(model);
+    return NULL;
   }
 
-  model->movie_features = (float **)malloc(num_movies * sizeof(float *));
+  for (int i = 0; i < num_users; i++) {
+    model->user_features[i] =
+        model->user_feature_data + (size_t)i * num_factors;
+  }
   for (int i = 0; i < num_movies; i++) {
-    model->movie_features[i] = (float *)malloc(num_factors * sizeof(float));
+    model->movie_features[i] =
+        model->movie_feature_data + (size_t)i * num_factors;
   }
 
-  model->user_bias = (float *)calloc(num_users, sizeof(float));
-  model->movie_bias = (float *)calloc(num_movies, sizeof(float));
-
   return model;
 }
 
 void free_model(Model *model) {
   if (model) {
-    for (int i = 0; i < model->num_users; i++) {
-      free(model->user_features[i]);
-    }
-    free(model->user_features);
-
-    for (int i = 0; i < model->num_movies; i++) {
-      free(model->movie_features[i]);
-    }
-    free(model->movie_features);
-
-    free(model->user_bias);
-    free(model->movie_bias);
-
+    arena_destroy(model->arena);
     free(model);
   }
 }
 
-void initialize_model(Model *model, int rank) {
-  unsigned int seed = time(NULL) + rank;
+// splitmix64 used as a counter-based generator: every parameter is a pure
+// function of (seed, matrix, row, factor), so the initial model does not
+// depend on the number of ranks or threads, or on the order of the fill.
+static inline float init_value(uint64_t key, uint64_t counter) {
+  uint64_t bits = splitmix64(key + counter);
+  return (float)(bits >> 40) * (1.0f / 16777216.0f) * 0.1f;
+}
 
+void initialize_model(Model *model, unsigned long long seed) {
+  uint64_t user_key = splitmix64(seed);
+  uint64_t movie_key = splitmix64(user_key);
+  int num_factors = model->num_factors;
+
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < model->num_users; i++) {
-    for (int j = 0; j < model->num_factors; j++) {
-      model->user_features[i][j] = ((float)rand_r(&seed) / RAND_MAX) * 0.1;
+    for (int j = 0; j < num_factors; j++) {
+      model->user_features[i][j] =
+          init_value(user_key, (uint64_t)i * num_factors + j);
     }
   }
 
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < model->num_movies; i++) {
-    for (int j = 0; j < model->num_factors; j++) {
-      model->movie_features[i][j] = ((float)rand_r(&seed) / RAND_MAX) * 0.1;
+    for (int j = 0; j < num_factors; j++) {
+      model->movie_features[i][j] =
+          init_value(movie_key, (uint64_t)i * num_factors + j);
     }
   }
 }
@@ -83,12 +109,10 @@ void save_model(const char *filename, Model *model) {
   fwrite(model->user_bias, sizeof(float), model->num_users, f);
   fwrite(model->movie_bias, sizeof(float), model->num_movies, f);
 
-  for (int i = 0; i < model->num_users; i++) {
-    fwrite(model->user_features[i], sizeof(float), model->num_factors, f);
-  }
-  for (int i = 0; i < model->num_movies; i++) {
-    fwrite(model->movie_features[i], sizeof(float), model->num_factors, f);
-  }
+  fwrite(model->user_feature_data, sizeof(float),
+         (size_t)model->num_users * model->num_factors, f);
+  fwrite(model->movie_feature_data, sizeof(float),
+         (size_t)model->num_movies * model->num_factors, f);
   fclose(f);
 }
 
@@ -102,103 +126,204 @@ Model *load_model(const char *filename) {
     return NULL;
   }
 
-  Model *model = (Model *)malloc(sizeof(Model));
-
-  if (fread(&model->num_users, sizeof(int), 1, f) != 1) {
-    fprintf(stderr, "Error reading num_users from model file\n");
-    free(model);
+  int header[3];
+  float global_mean;
+  if (fread(header, sizeof(int), 3, f) != 3 ||
+      fread(&global_mean, sizeof(float), 1, f) != 1) {
+    fprintf(stderr, "Error reading model header\n");
     fclose(f);
     return NULL;
   }
 
-  if (fread(&model->num_movies, sizeof(int), 1, f) != 1) {
-    fprintf(stderr, "Error reading num_movies from model file\n");
-    free(model);
+  Model *model = create_model(header[0], header[1], header[2], 0.001f, 0.01f);
+  if (!model) {
+    fprintf(stderr, "Error: out of memory for a %d x %d x %d model\n",
+            header[0], header[1], header[2]);
     fclose(f);
     return NULL;
   }
+  model->global_mean = global_mean;
 
-  if (fread(&model->num_factors, sizeof(int), 1, f) != 1) {
-    fprintf(stderr, "Error reading num_factors from model file\n");
-    free(model);
+  size_t user_values = (size_t)model->num_users * model->num_factors;
+  size_t movie_values = (size_t)model->num_movies * model->num_factors;
+  if (fread(model->user_bias, sizeof(float), model->num_users, f) !=
+      (size_t)model->num_users) {
+    fprintf(stderr, "Error reading user_bias from model file\n");
+  } else if (fread(model->movie_bias, sizeof(float), model->num_movies, f) !=
+             (size_t)model->num_movies) {
+    fprintf(stderr, "Error reading movie_bias from model file\n");
+  } else if (fread(model->user_feature_data, sizeof(float), user_values, f) !=
+             user_values) {
+    fprintf(stderr, "Error reading user features from model file\n");
+  } else if (fread(model->movie_feature_data, sizeof(float), movie_values,
+                   f) != movie_values) {
+    fprintf(stderr, "Error reading movie features from model file\n");
+  } else {
     fclose(f);
-    return NULL;
+    return model;
   }
 
-  model->learning_rate = 0.001f;
-  model->regularization = 0.01f;
+  free_model(model);
+  fclose(f);
+  return NULL;
+}
 
-  if (fread(&model->global_mean, sizeof(float), 1, f) != 1) {
-    fprintf(stderr, "Error reading global_mean from model file\n");
-    free(model);
-    fclose(f);
-    return NULL;
-  }
+static const char *precision_names[] = {"fp32", "fp16", "int8"};
 
-  model->user_bias = (float *)malloc(model->num_users * sizeof(float));
-  if (fread(model->user_bias, sizeof(float), model->num_users, f) !=
-      (size_t)model->num_users) {
-    fprintf(stderr, "Error reading user_bias from model file\n");
-    free(model->user_bias);
-    free(model);
-    fclose(f);
-    return NULL;
+int parse_precision(const char *name, Precision *precision) {
+  for (int p = PRECISION_FP32; p <= PRECISION_INT8; p++) {
+    if (strcmp(name, precision_names[p]) == 0) {
+      *precision = (Precision)p;
+      return 1;
+    }
   }
+  return 0;
+}
 
-  model->movie_bias = (float *)malloc(model->num_movies * sizeof(float));
-  if (fread(model->movie_bias, sizeof(float), model->num_movies, f) !=
-      (size_t)model->num_movies) {
-    fprintf(stderr, "Error reading movie_bias from model file\n");
-    free(model->user_bias);
-    free(model->movie_bias);
-    free(model);
-    fclose(f);
-    return NULL;
+const char *precision_name(Precision precision) {
+  return precision_names[precision];
+}
+
+// Layout: int magic, num_movies, num_factors, precision; float global_mean;
+// float movie_bias[num_movies]; then the movie factors. int8 rows are
+// preceded by all num_movies row scales.
+int save_serving_model(const char *filename, const Model *model,
+                       Precision precision) {
+  FILE *f = fopen(filename, "wb");
+  if (!f) {
+    fprintf(stderr, "Error saving serving model to %s: %s\n", filename,
+            strerror(errno));
+    return 0;
   }
 
-  model->user_features = (float **)malloc(model->num_users * sizeof(float *));
-  for (int i = 0; i < model->num_users; i++) {
-    model->user_features[i] =
-        (float *)malloc(model->num_factors * sizeof(float));
-    if (fread(model->user_features[i], sizeof(float), model->num_factors, f) !=
-        (size_t)model->num_factors) {
-      fprintf(stderr, "Error reading user features at index %d\n", i);
-      for (int j = 0; j <= i; j++) {
-        free(model->user_features[j]);
-      }
-      free(model->user_features);
-      free(model->user_bias);
-      free(model->movie_bias);
-      free(model);
-      fclose(f);
-      return NULL;
+  int n = model->num_movies, d = model->num_factors;
+  size_t values = (size_t)n * d;
+  int header[4] = {SERVING_MAGIC, n, d, (int)precision};
+  int ok = fwrite(header, sizeof(int), 4, f) == 4 &&
+           fwrite(&model->global_mean, sizeof(float), 1, f) == 1 &&
+           fwrite(model->movie_bias, sizeof(float), n, f) == (size_t)n;
+
+  if (ok && precision == PRECISION_FP32) {
+    ok = fwrite(model->movie_feature_data, sizeof(float), values, f) ==
+         values;
+  } else if (ok && precision == PRECISION_FP16) {
+    uint16_t *halves = (uint16_t *)malloc((values + 1) * sizeof(uint16_t));
+    for (size_t i = 0; i < values; i++)
+      halves[i] = float_to_half(model->movie_feature_data[i]);
+    ok = fwrite(halves, sizeof(uint16_t), values, f) == values;
+    free(halves);
+  } else if (ok) {
+    float *scales = (float *)malloc((n + 1) * sizeof(float));
+    int8_t *codes = (int8_t *)malloc(values + 1);
+    for (int i = 0; i < n; i++) {
+      scales[i] = quantize_row_int8(model->movie_features[i], d,
+                                    codes + (size_t)i * d);
     }
+    ok = fwrite(scales, sizeof(float), n, f) == (size_t)n &&
+         fwrite(codes, 1, values, f) == values;
+    free(scales);
+    free(codes);
   }
 
-  model->movie_features = (float **)malloc(model->num_movies * sizeof(float *));
-  for (int i = 0; i < model->num_movies; i++) {
-    model->movie_features[i] =
-        (float *)malloc(model->num_factors * sizeof(float));
-    if (fread(model->movie_features[i], sizeof(float), model->num_factors, f) !=
-        (size_t)model->num_factors) {
-      fprintf(stderr, "Error reading movie features at index %d\n", i);
-      for (int j = 0; j < model->num_users; j++) {
-        free(model->user_features[j]);
-      }
-      free(model->user_features);
-      for (int j = 0; j <= i; j++) {
-        free(model->movie_features[j]);
-      }
-      free(model->movie_features);
-      free(model->user_bias);
-      free(model->movie_bias);
-      free(model);
-      fclose(f);
-      return NULL;
-    }
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "Error writing serving model to %s\n", filename);
+    return 0;
+  }
+  return 1;
+}
+
+// Returns a model with no users, or NULL without printing if the stream is
+// not a complete serving model. Quantized factors are expanded back to fp32;
+// if rows is not NULL it also receives the stored halves or codes.
+Model *read_serving_model(FILE *f, Precision *precision, ServingRows *rows) {
+  int header[4];
+  float global_mean;
+  if (fread(header, sizeof(int), 4, f) != 4 || header[0] != SERVING_MAGIC ||
+      header[1] <= 0 || header[2] <= 0 || header[3] < PRECISION_FP32 ||
+      header[3] > PRECISION_INT8 ||
+      fread(&global_mean, sizeof(float), 1, f) != 1)
+    return NULL;
+
+  int n = header[1], d = header[2];
+  size_t values = (size_t)n * d;
+  *precision = (Precision)header[3];
+
+  // The header must account for exactly the bytes left in the file before
+  // anything is sized from it; a corrupt n or d would otherwise ask for an
+  // arbitrarily large model.
+  static const size_t value_bytes[] = {sizeof(float), sizeof(uint16_t), 1};
+  size_t row_bytes = (*precision == PRECISION_INT8 ? 2 : 1) * sizeof(float);
+  long start = ftell(f);
+  if (start < 0 || fseek(f, 0, SEEK_END) != 0)
+    return NULL;
+  long end = ftell(f);
+  if (end < start || fseek(f, start, SEEK_SET) != 0)
+    return NULL;
+  size_t remaining = (size_t)(end - start);
+  size_t elem = value_bytes[*precision];
+  if (remaining < (size_t)n * row_bytes ||
+      (remaining - (size_t)n * row_bytes) % elem != 0 ||
+      (remaining - (size_t)n * row_bytes) / elem != values)
+    return NULL;
+
+  ServingRows stored = {NULL, NULL, NULL};
+  Model *model = create_model(0, n, d, 0.001f, 0.01f);
+  if (!model)
+    return NULL;
+  model->global_mean = global_mean;
+
+  int ok = fread(model->movie_bias, sizeof(float), n, f) == (size_t)n;
+  if (ok && *precision == PRECISION_FP32) {
+    ok = fread(model->movie_feature_data, sizeof(float), values, f) == values;
+  } else if (ok && *precision == PRECISION_FP16) {
+    stored.halves = (uint16_t *)malloc((values + 1) * sizeof(uint16_t));
+    ok = stored.halves &&
+         fread(stored.halves, sizeof(uint16_t), values, f) == values;
+    for (size_t i = 0; ok && i < values; i++)
+      model->movie_feature_data[i] = half_to_float(stored.halves[i]);
+  } else if (ok) {
+    stored.scales = (float *)malloc((n + 1) * sizeof(float));
+    stored.codes = (int8_t *)malloc(values + 1);
+    ok = stored.scales && stored.codes &&
+         fread(stored.scales, sizeof(float), n, f) == (size_t)n &&
+         fread(stored.codes, 1, values, f) == values;
+    for (size_t i = 0; ok && i < values; i++)
+      model->movie_feature_data[i] = stored.scales[i / d] * stored.codes[i];
   }
 
+  if (!ok) {
+    free_serving_rows(&stored);
+    free_model(model);
+    return NULL;
+  }
+  if (rows)
+    *rows = stored;
+  else
+    free_serving_rows(&stored);
+  return model;
+}
+
+void free_serving_rows(ServingRows *rows) {
+  free(rows->halves);
+  free(rows->codes);
+  free(rows->scales);
+  rows->halves = NULL;
+  rows->codes = NULL;
+  rows->scales = NULL;
+}
+
+Model *load_serving_model(const char *filename, Precision *precision,
+                          ServingRows *rows) {
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+    fprintf(stderr, "Error opening serving model '%s': %s\n", filename,
+            strerror(errno));
+    return NULL;
+  }
+  Model *model = read_serving_model(f, precision, rows);
   fclose(f);
+  if (!model)
+    fprintf(stderr, "Error: %s is not a valid serving model\n", filename);
   return model;
 }
 
@@ -2,13 +2,45 @@
 #define MODEL_H
 
 #include "data_structures.h"
+#include <stdint.h>
+#include <stdio.h>
 
+static inline uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// NULL if the model's memory cannot be mapped.
 Model *create_model(int num_users, int num_movies, int num_factors,
                     float learning_rate, float regularization);
 void free_model(Model *model);
-void initialize_model(Model *model, int rank);
+void initialize_model(Model *model, unsigned long long seed);
 void save_model(const char *filename, Model *model);
 Model *load_model(const char *filename);
+// Serving artifact: only what scoring a folded-in user needs. The movie
+// factors are stored as fp32, fp16, or int8 with one fp32 scale per row.
+#define SERVING_MAGIC 0x56524553
+
+typedef enum { PRECISION_FP32, PRECISION_FP16, PRECISION_INT8 } Precision;
+
+// The movie factors exactly as a quantized serving file stores them: fp16
+// halves, or int8 codes with one scale per row. Unused fields are NULL.
+typedef struct {
+  uint16_t *halves;
+  int8_t *codes;
+  float *scales;
+} ServingRows;
+
+int parse_precision(const char *name, Precision *precision);
+const char *precision_name(Precision precision);
+int save_serving_model(const char *filename, const Model *model,
+                       Precision precision);
+Model *read_serving_model(FILE *f, Precision *precision, ServingRows *rows);
+Model *load_serving_model(const char *filename, Precision *precision,
+                          ServingRows *rows);
+void free_serving_rows(ServingRows *rows);
 void compute_global_mean(Model *model, Dataset *dataset);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "model_io.h"
+#include "model.h"
+#include <errno.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MODEL_HEADER_SIZE (3 * sizeof(int) + sizeof(float))
+
+void owned_range(int num_rows, int rank, int size, int *start, int *end) {
+  *start = (int)((long long)num_rows * rank / size);
+  *end = (int)((long long)num_rows * (rank + 1) / size);
+}
+
+// Collective write of count items at offset; fails on an MPI error or a
+// short write.
+int write_slice(MPI_File fh, MPI_Offset offset, const void *data, int count,
+                MPI_Datatype type) {
+  MPI_Status status;
+  int written;
+  if (MPI_File_write_at_all(fh, offset, data, count, type, &status) !=
+      MPI_SUCCESS)
+    return 0;
+  MPI_Get_count(&status, type, &written);
+  return written == count;
+}
+
+// Collective. If no rank failed, rank 0 renames the finished temporary file
+// into place; otherwise it removes it, so a failed run never leaves a
+// truncated output behind. Returns 1 on every rank only if the file was
+// published.
+int publish_file(const char *tmp_filename, const char *filename, int failed,
+                 int rank) {
+  MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (failed) {
+      fprintf(stderr, "Error writing %s\n", tmp_filename);
+      remove(tmp_filename);
+    } else if (rename(tmp_filename, filename) != 0) {
+      fprintf(stderr, "Error renaming %s to %s: %s\n", tmp_filename, filename,
+              strerror(errno));
+      failed = 1;
+    }
+  }
+  MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  return !failed;
+}
+
+// Writes the same layout as save_model, but every rank writes the bias and
+// feature rows it owns straight from the model's contiguous blocks with one
+// collective call per section. After the final synchronization all ranks hold
+// the full model, so no data moves between ranks; the file is sized up front
+// and the MPI-IO layer aggregates the slices into large, stripe-aligned
+// requests. Returns 1 on every rank only if every rank's writes succeeded.
+int save_model_parallel(const char *filename, Model *model, int rank,
+                        int size) {
+  MPI_Info info;
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "romio_cb_write", "enable");
+
+  MPI_File fh;
+  int err = MPI_File_open(MPI_COMM_WORLD, filename,
+                          MPI_MODE_CREATE | MPI_MODE_WRONLY, info, &fh);
+  MPI_Info_free(&info);
+  if (err != MPI_SUCCESS) {
+    if (rank == 0) {
+      fprintf(stderr, "Error opening %s for parallel write\n", filename);
+    }
+    return 0;
+  }
+
+  int num_factors = model->num_factors;
+  MPI_Offset user_bias_off = MODEL_HEADER_SIZE;
+  MPI_Offset movie_bias_off =
+      user_bias_off + (MPI_Offset)model->num_users * sizeof(float);
+  MPI_Offset user_feat_off =
+      movie_bias_off + (MPI_Offset)model->num_movies * sizeof(float);
+  MPI_Offset movie_feat_off =
+      user_feat_off +
+      (MPI_Offset)model->num_users * num_factors * sizeof(float);
+  MPI_Offset file_size =
+      movie_feat_off +
+      (MPI_Offset)model->num_movies * num_factors * sizeof(float);
+  int failed = MPI_File_set_size(fh, file_size) != MPI_SUCCESS;
+
+  int user_start, user_end, movie_start, movie_end;
+  owned_range(model->num_users, rank, size, &user_start, &user_end);
+  owned_range(model->num_movies, rank, size, &movie_start, &movie_end);
+  int local_users = user_end - user_start;
+  int local_movies = movie_end - movie_start;
+
+  char header[MODEL_HEADER_SIZE];
+  memcpy(header, &model->num_users, sizeof(int));
+  memcpy(header + sizeof(int), &model->num_movies, sizeof(int));
+  memcpy(header + 2 * sizeof(int), &model->num_factors, sizeof(int));
+  memcpy(header + 3 * sizeof(int), &model->global_mean, sizeof(float));
+
+  // Every call is collective, so all ranks issue all five even after a
+  // failure and agree on the outcome before the caller publishes the file.
+  failed |= !write_slice(fh, 0, header,
+                         rank == 0 ? (int)MODEL_HEADER_SIZE : 0, MPI_BYTE);
+  failed |= !write_slice(
+      fh, user_bias_off + (MPI_Offset)user_start * sizeof(float),
+      model->user_bias + user_start, local_users, MPI_FLOAT);
+  failed |= !write_slice(
+      fh, movie_bias_off + (MPI_Offset)movie_start * sizeof(float),
+      model->movie_bias + movie_start, local_movies, MPI_FLOAT);
+  failed |= !write_slice(
+      fh, user_feat_off + (MPI_Offset)user_start * num_factors * sizeof(float),
+      model->user_feature_data + (size_t)user_start * num_factors,
+      local_users * num_factors, MPI_FLOAT);
+  failed |= !write_slice(
+      fh,
+      movie_feat_off + (MPI_Offset)movie_start * num_factors * sizeof(float),
+      model->movie_feature_data + (size_t)movie_start * num_factors,
+      local_movies * num_factors, MPI_FLOAT);
+
+  failed |= MPI_File_close(&fh) != MPI_SUCCESS;
+  MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+  if (failed && rank == 0) {
+    fprintf(stderr, "Error writing %s\n", filename);
+  }
+  return !failed;
+}
+
+// Reads only this rank's owned_range slice of the movie biases and factors,
+// so no rank ever holds the whole catalog. The returned model has no users;
+// its movie j is movie *movie_start + j of the full model. Collective.
+Model *load_model_shard(const char *filename, int rank, int size,
+                        int *movie_start, int *total_movies) {
+  MPI_File fh;
+  if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_RDONLY, MPI_INFO_NULL,
+                    &fh) != MPI_SUCCESS) {
+    if (rank == 0)
+      fprintf(stderr, "Error opening model file '%s'\n", filename);
+    return NULL;
+  }
+
+  char header[MODEL_HEADER_SIZE];
+  MPI_File_read_at_all(fh, 0, header, (int)MODEL_HEADER_SIZE, MPI_BYTE,
+                       MPI_STATUS_IGNORE);
+  int num_users, num_movies, num_factors;
+  float global_mean;
+  memcpy(&num_users, header, sizeof(int));
+  memcpy(&num_movies, header + sizeof(int), sizeof(int));
+  memcpy(&num_factors, header + 2 * sizeof(int), sizeof(int));
+  memcpy(&global_mean, header + 3 * sizeof(int), sizeof(float));
+
+  MPI_Offset file_size;
+  MPI_File_get_size(fh, &file_size);
+  MPI_Offset movie_bias_off =
+      MODEL_HEADER_SIZE + (MPI_Offset)num_users * sizeof(float);
+  MPI_Offset movie_feat_off =
+      movie_bias_off + (MPI_Offset)num_movies * sizeof(float) +
+      (MPI_Offset)num_users * num_factors * sizeof(float);
+  if (num_users < 0 || num_movies < size || num_factors <= 0 ||
+      file_size != movie_feat_off + (MPI_Offset)num_movies * num_factors *
+                                         sizeof(float)) {
+    if (rank == 0)
+      fprintf(stderr, "Error: %s is corrupt or has fewer movies than ranks\n",
+              filename);
+    MPI_File_close(&fh);
+    return NULL;
+  }
+
+  int start, end;
+  owned_range(num_movies, rank, size, &start, &end);
+  Model *model = create_model(0, end - start, num_factors, 0.001f, 0.01f);
+  if (!model) {
+    fprintf(stderr, "Error: out of memory for a %d x %d model shard\n",
+            end - start, num_factors);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  model->global_mean = global_mean;
+  MPI_File_read_at_all(fh, movie_bias_off + (MPI_Offset)start * sizeof(float),
+                       model->movie_bias, end - start, MPI_FLOAT,
+                       MPI_STATUS_IGNORE);
+  MPI_File_read_at_all(
+      fh, movie_feat_off + (MPI_Offset)start * num_factors * sizeof(float),
+      model->movie_feature_data, (end - start) * num_factors, MPI_FLOAT,
+      MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+
+  *movie_start = start;
+  *total_movies = num_movies;
+  return model;
+}
@@ -0,0 +1,17 @@
+#ifndef MODEL_IO_H
+#define MODEL_IO_H
+
+#include "data_structures.h"
+#include <mpi.h>
+
+void owned_range(int num_rows, int rank, int size, int *start, int *end);
+int write_slice(MPI_File fh, MPI_Offset offset, const void *data, int count,
+                MPI_Datatype type);
+int publish_file(const char *tmp_filename, const char *filename, int failed,
+                 int rank);
+int save_model_parallel(const char *filename, Model *model, int rank,
+                        int size);
+Model *load_model_shard(const char *filename, int rank, int size,
+                        int *movie_start, int *total_movies);
+
+#endif
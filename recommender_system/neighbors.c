@@ -0,0 +1,50 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "neighbors.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+NeighborTable *neighbors_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(NeighborHeader)) {
+    close(fd);
+    return NULL;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  const NeighborHeader *head = (const NeighborHeader *)base;
+  size_t cells = (size_t)head->num_movies * head->num_neighbors;
+  size_t expected = sizeof(NeighborHeader) +
+                    cells * (sizeof(int32_t) + sizeof(float));
+  if (head->magic != NEIGHBORS_MAGIC || expected != (size_t)st.st_size) {
+    fprintf(stderr, "Error: %s is not a valid neighbor file\n", filename);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  NeighborTable *table = (NeighborTable *)malloc(sizeof(NeighborTable));
+  table->base = base;
+  table->size = st.st_size;
+  table->num_movies = (int)head->num_movies;
+  table->num_neighbors = (int)head->num_neighbors;
+  table->ids = (const int32_t *)((const char *)base + sizeof(NeighborHeader));
+  table->similarities = (const float *)(table->ids + cells);
+  return table;
+}
+
+void neighbors_close(NeighborTable *table) {
+  if (table) {
+    munmap(table->base, table->size);
+    free(table);
+  }
+}
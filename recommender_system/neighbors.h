@@ -0,0 +1,41 @@
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NEIGHBORS_MAGIC 0x4842474e
+
+typedef struct {
+  uint32_t magic;
+  uint32_t num_movies;
+  uint32_t num_neighbors;
+  uint32_t reserved;
+} NeighborHeader;
+
+// Precomputed item-item neighbors, mapped read-only. Row i of `ids` holds the
+// num_neighbors movies most similar to movie i, best first, padded with -1;
+// `similarities` holds their cosine similarities in the same layout.
+typedef struct {
+  void *base;
+  size_t size;
+  int num_movies;
+  int num_neighbors;
+  const int32_t *ids;
+  const float *similarities;
+} NeighborTable;
+
+NeighborTable *neighbors_open(const char *filename);
+void neighbors_close(NeighborTable *table);
+
+static inline const int32_t *neighbor_ids(const NeighborTable *table,
+                                          int movie) {
+  return table->ids + (size_t)movie * table->num_neighbors;
+}
+
+static inline const float *neighbor_similarities(const NeighborTable *table,
+                                                 int movie) {
+  return table->similarities + (size_t)movie * table->num_neighbors;
+}
+
+#endif
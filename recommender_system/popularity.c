@@ -0,0 +1,120 @@
+#include "popularity.h"
+#include "topk.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static MovieStats *stats_alloc(int num_movies) {
+  MovieStats *stats = (MovieStats *)malloc(sizeof(MovieStats));
+  stats->num_movies = num_movies;
+  stats->counts = (int *)calloc(num_movies, sizeof(int));
+  stats->means = (float *)malloc(num_movies * sizeof(float));
+  stats->scores = (float *)malloc(num_movies * sizeof(float));
+  stats->ranking = (int *)malloc(num_movies * sizeof(int));
+  return stats;
+}
+
+// Layout: int header[4] {magic, num_movies, 0, 0}, float global_mean,
+// float prior_weight, then counts, means, scores and ranking, num_movies
+// values each.
+int save_movie_stats(const char *filename, const Dataset *dataset,
+                     float prior_weight) {
+  int n = dataset->num_movies;
+  MovieStats *stats = stats_alloc(n);
+  double *sums = (double *)calloc(n, sizeof(double));
+  double total = 0.0;
+  for (int i = 0; i < dataset->num_ratings; i++) {
+    int movie = dataset->ratings[i].movie_id;
+    stats->counts[movie]++;
+    sums[movie] += dataset->ratings[i].rating;
+    total += dataset->ratings[i].rating;
+  }
+  double mu = dataset->num_ratings > 0 ? total / dataset->num_ratings : 0.0;
+  stats->global_mean = (float)mu;
+  stats->prior_weight = prior_weight;
+  Candidate *ranked = (Candidate *)malloc((n + 1) * sizeof(Candidate));
+  for (int j = 0; j < n; j++) {
+    int count = stats->counts[j];
+    stats->means[j] = count > 0 ? (float)(sums[j] / count) : 0.0f;
+    stats->scores[j] =
+        (float)((sums[j] + prior_weight * mu) / (count + prior_weight));
+    ranked[j].score = stats->scores[j];
+    ranked[j].id = j;
+  }
+  qsort(ranked, n, sizeof(Candidate), compare_candidates);
+  for (int i = 0; i < n; i++)
+    stats->ranking[i] = ranked[i].id;
+  free(ranked);
+  free(sums);
+
+  int header[4] = {STATS_MAGIC, n, 0, 0};
+  FILE *f = fopen(filename, "wb");
+  int ok = f && fwrite(header, sizeof(int), 4, f) == 4 &&
+           fwrite(&stats->global_mean, sizeof(float), 1, f) == 1 &&
+           fwrite(&stats->prior_weight, sizeof(float), 1, f) == 1 &&
+           fwrite(stats->counts, sizeof(int), n, f) == (size_t)n &&
+           fwrite(stats->means, sizeof(float), n, f) == (size_t)n &&
+           fwrite(stats->scores, sizeof(float), n, f) == (size_t)n &&
+           fwrite(stats->ranking, sizeof(int), n, f) == (size_t)n;
+  if (f && fclose(f) != 0)
+    ok = 0;
+  if (!ok)
+    fprintf(stderr, "Error writing %s\n", filename);
+  movie_stats_free(stats);
+  return ok;
+}
+
+// Returns NULL if the file is missing or was written for a different model.
+MovieStats *load_movie_stats(const char *filename, int num_movies) {
+  FILE *f = fopen(filename, "rb");
+  if (!f)
+    return NULL;
+  int header[4];
+  MovieStats *stats = stats_alloc(num_movies);
+  size_t n = (size_t)num_movies;
+  int ok = fread(header, sizeof(int), 4, f) == 4 &&
+           header[0] == STATS_MAGIC && header[1] == num_movies &&
+           fread(&stats->global_mean, sizeof(float), 1, f) == 1 &&
+           fread(&stats->prior_weight, sizeof(float), 1, f) == 1 &&
+           fread(stats->counts, sizeof(int), n, f) == n &&
+           fread(stats->means, sizeof(float), n, f) == n &&
+           fread(stats->scores, sizeof(float), n, f) == n &&
+           fread(stats->ranking, sizeof(int), n, f) == n;
+  fclose(f);
+  if (!ok) {
+    fprintf(stderr, "Warning: ignoring stale %s\n", filename);
+    movie_stats_free(stats);
+    return NULL;
+  }
+  return stats;
+}
+
+void movie_stats_free(MovieStats *stats) {
+  if (!stats)
+    return;
+  free(stats->counts);
+  free(stats->means);
+  free(stats->scores);
+  free(stats->ranking);
+  free(stats);
+}
+
+// The best k movies by shrunk score that pass the genre filter and have at
+// least min_count ratings, best first. Walks the precomputed ranking, so an
+// unfiltered request reads exactly k entries and a filtered one stops as
+// soon as k movies qualify. Returns the number written to movies.
+int movie_stats_top_k(const MovieStats *stats, const uint64_t *genre_masks,
+                      uint64_t include_genres, uint64_t exclude_genres,
+                      int min_count, int k, int *movies) {
+  int found = 0;
+  for (int i = 0; i < stats->num_movies && found < k; i++) {
+    int j = stats->ranking[i];
+    if (stats->counts[j] < min_count)
+      continue;
+    if (genre_masks &&
+        ((include_genres && !(genre_masks[j] & include_genres)) ||
+         (genre_masks[j] & exclude_genres)))
+      continue;
+    movies[found++] = j;
+  }
+  return found;
+}
@@ -0,0 +1,33 @@
+#ifndef POPULARITY_H
+#define POPULARITY_H
+
+#include "data_structures.h"
+#include <stdint.h>
+
+#define STATS_MAGIC 0x54415453
+
+// Per-movie rating statistics written by train_save, indexed like
+// movie_mapping.bin. `scores` are Bayesian averages that shrink each movie's
+// mean rating toward the global mean by `prior_weight` pseudo-ratings, so a
+// movie with two 5-star ratings does not outrank one with thousands of 4.5s.
+// `ranking` lists every movie by descending score; its first K entries are
+// the global top-K.
+typedef struct {
+  int num_movies;
+  float global_mean;
+  float prior_weight;
+  int *counts;
+  float *means;
+  float *scores;
+  int *ranking;
+} MovieStats;
+
+int save_movie_stats(const char *filename, const Dataset *dataset,
+                     float prior_weight);
+MovieStats *load_movie_stats(const char *filename, int num_movies);
+void movie_stats_free(MovieStats *stats);
+int movie_stats_top_k(const MovieStats *stats, const uint64_t *genre_masks,
+                      uint64_t include_genres, uint64_t exclude_genres,
+                      int min_count, int k, int *movies);
+
+#endif
@@ -0,0 +1,259 @@
+#include "quant_score.h"
+#include "quantize.h"
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+QuantCatalog *quant_catalog_create(const Model *model, Precision precision,
+                                   const ServingRows *stored) {
+  QuantCatalog *catalog = (QuantCatalog *)calloc(1, sizeof(QuantCatalog));
+  int n = model->num_movies, d = model->num_factors;
+  int dp = (d + 1) / 2 * 2;
+  catalog->precision = precision;
+  catalog->num_movies = n;
+  catalog->num_factors = d;
+  catalog->padded_factors = dp;
+  catalog->num_panels = (n + QUANT_NR - 1) / QUANT_NR;
+  catalog->use_avx2 = __builtin_cpu_supports("avx2") &&
+                      __builtin_cpu_supports("fma") &&
+                      __builtin_cpu_supports("f16c");
+  size_t panel_size = (size_t)dp * QUANT_NR;
+  size_t values = catalog->num_panels * panel_size;
+
+  if (precision == PRECISION_FP32)
+    catalog->rows = (float *)calloc(values + 1, sizeof(float));
+  else if (precision == PRECISION_FP16)
+    catalog->halves = (uint16_t *)calloc(values + 1, sizeof(uint16_t));
+  else
+    catalog->codes = (int8_t *)calloc(values + 1, 1);
+  catalog->scales = (float *)calloc(catalog->num_panels * QUANT_NR,
+                                    sizeof(float));
+
+  const uint16_t *halves = stored ? stored->halves : NULL;
+  const int8_t *codes = stored ? stored->codes : NULL;
+  int8_t *row_codes = (int8_t *)malloc(d + 1);
+  for (int j = 0; j < n; j++) {
+    const float *row = model->movie_features[j];
+    size_t panel = (size_t)(j / QUANT_NR) * panel_size;
+    int lane = j % QUANT_NR;
+    if (precision == PRECISION_INT8 && codes) {
+      catalog->scales[j] = stored->scales[j];
+      memcpy(row_codes, codes + (size_t)j * d, d);
+    } else if (precision == PRECISION_INT8) {
+      catalog->scales[j] = quantize_row_int8(row, d, row_codes);
+    }
+    for (int k = 0; k < d; k++) {
+      if (precision == PRECISION_FP32) {
+        catalog->rows[panel + (size_t)k * QUANT_NR + lane] = row[k];
+      } else if (precision == PRECISION_FP16) {
+        catalog->halves[panel + (size_t)k * QUANT_NR + lane] =
+            halves ? halves[(size_t)j * d + k] : float_to_half(row[k]);
+      } else {
+        size_t at = panel + (size_t)(k / 2) * 2 * QUANT_NR + 2 * lane + k % 2;
+        catalog->codes[at] = row_codes[k];
+      }
+    }
+  }
+  free(row_codes);
+  return catalog;
+}
+
+void quant_catalog_free(QuantCatalog *catalog) {
+  if (catalog) {
+    free(catalog->rows);
+    free(catalog->halves);
+    free(catalog->codes);
+    free(catalog->scales);
+    free(catalog);
+  }
+}
+
+size_t quant_catalog_movie_bytes(const QuantCatalog *catalog) {
+  switch (catalog->precision) {
+  case PRECISION_FP32:
+    return catalog->num_factors * sizeof(float);
+  case PRECISION_FP16:
+    return catalog->num_factors * sizeof(uint16_t);
+  default:
+    return catalog->padded_factors + sizeof(float);
+  }
+}
+
+static float dot(const float *a, const float *b, int n) {
+  float sum = 0.0f;
+  for (int k = 0; k < n; k++)
+    sum += a[k] * b[k];
+  return sum;
+}
+
+// Portable panel scans: each accumulates QUANT_NR movies in parallel lanes,
+// so there are no horizontal reductions.
+static void scan_fp32(const float *query, const float *panel, int d,
+                      float *out) {
+  float acc[QUANT_NR] = {0};
+  for (int k = 0; k < d; k++) {
+#pragma omp simd
+    for (int j = 0; j < QUANT_NR; j++)
+      acc[j] += query[k] * panel[k * QUANT_NR + j];
+  }
+  memcpy(out, acc, sizeof(acc));
+}
+
+// Half to float without branches: the half's sign, exponent and mantissa are
+// moved into float position, and the exponent bias difference is applied by
+// one multiply at the end. Valid for the finite values a trained model holds.
+static void scan_fp16(const float *query, const uint16_t *panel, int d,
+                      float *out) {
+  float acc[QUANT_NR] = {0};
+  for (int k = 0; k < d; k++) {
+#pragma omp simd
+    for (int j = 0; j < QUANT_NR; j++) {
+      uint16_t h = panel[k * QUANT_NR + j];
+      union {
+        uint32_t bits;
+        float value;
+      } v;
+      v.bits = ((uint32_t)(h & 0x8000) << 16) | ((uint32_t)(h & 0x7fff) << 13);
+      acc[j] += query[k] * v.value;
+    }
+  }
+  for (int j = 0; j < QUANT_NR; j++)
+    out[j] = acc[j] * 0x1p112f;
+}
+
+static void scan_int8(const int8_t *query, const int8_t *panel, int dp,
+                      float *out) {
+  int32_t acc[QUANT_NR] = {0};
+  for (int k = 0; k < dp; k += 2) {
+    const int8_t *pairs = panel + k * QUANT_NR;
+#pragma omp simd
+    for (int j = 0; j < QUANT_NR; j++) {
+      acc[j] += query[k] * pairs[2 * j] + query[k + 1] * pairs[2 * j + 1];
+    }
+  }
+  for (int j = 0; j < QUANT_NR; j++)
+    out[j] = (float)acc[j];
+}
+
+// AVX2 versions, used when the CPU has AVX2, FMA and F16C. The fp16 scan
+// converts eight halves per instruction, and the int8 scan sign-extends the
+// codes to 16 bits and multiplies-adds factor pairs into 32-bit lanes.
+#define QUANT_AVX2 __attribute__((target("avx2,fma,f16c")))
+
+QUANT_AVX2
+static void scan_fp32_avx2(const float *query, const float *panel, int d,
+                           float *out) {
+  __m256 lo = _mm256_setzero_ps(), hi = _mm256_setzero_ps();
+  for (int k = 0; k < d; k++) {
+    __m256 q = _mm256_set1_ps(query[k]);
+    lo = _mm256_fmadd_ps(q, _mm256_loadu_ps(panel + k * QUANT_NR), lo);
+    hi = _mm256_fmadd_ps(q, _mm256_loadu_ps(panel + k * QUANT_NR + 8), hi);
+  }
+  _mm256_storeu_ps(out, lo);
+  _mm256_storeu_ps(out + 8, hi);
+}
+
+QUANT_AVX2
+static void scan_fp16_avx2(const float *query, const uint16_t *panel, int d,
+                           float *out) {
+  __m256 lo = _mm256_setzero_ps(), hi = _mm256_setzero_ps();
+  for (int k = 0; k < d; k++) {
+    const __m128i *row = (const __m128i *)(panel + k * QUANT_NR);
+    __m256 q = _mm256_set1_ps(query[k]);
+    lo = _mm256_fmadd_ps(q, _mm256_cvtph_ps(_mm_loadu_si128(row)), lo);
+    hi = _mm256_fmadd_ps(q, _mm256_cvtph_ps(_mm_loadu_si128(row + 1)), hi);
+  }
+  _mm256_storeu_ps(out, lo);
+  _mm256_storeu_ps(out + 8, hi);
+}
+
+QUANT_AVX2
+static void scan_int8_avx2(const int8_t *query, const int8_t *panel, int dp,
+                           float *out) {
+  __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+  for (int k = 0; k < dp; k += 2) {
+    const __m128i *pairs = (const __m128i *)(panel + k * QUANT_NR);
+    __m256i q = _mm256_set1_epi32((uint16_t)query[k] |
+                                  ((uint32_t)(uint16_t)query[k + 1] << 16));
+    __m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128(pairs));
+    __m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128(pairs + 1));
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(a, q));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(b, q));
+  }
+  _mm256_storeu_ps(out, _mm256_cvtepi32_ps(lo));
+  _mm256_storeu_ps(out + 8, _mm256_cvtepi32_ps(hi));
+}
+
+static void scan_panel(const QuantCatalog *catalog, const float *query,
+                       const int8_t *query_codes, int p, float *out) {
+  size_t offset = (size_t)p * catalog->padded_factors * QUANT_NR;
+  int d = catalog->num_factors, dp = catalog->padded_factors;
+  if (catalog->precision == PRECISION_FP32) {
+    if (catalog->use_avx2)
+      scan_fp32_avx2(query, catalog->rows + offset, d, out);
+    else
+      scan_fp32(query, catalog->rows + offset, d, out);
+  } else if (catalog->precision == PRECISION_FP16) {
+    if (catalog->use_avx2)
+      scan_fp16_avx2(query, catalog->halves + offset, d, out);
+    else
+      scan_fp16(query, catalog->halves + offset, d, out);
+  } else {
+    if (catalog->use_avx2)
+      scan_int8_avx2(query_codes, catalog->codes + offset, dp, out);
+    else
+      scan_int8(query_codes, catalog->codes + offset, dp, out);
+  }
+}
+
+// Scans every movie in the compact format to keep the `rerank` best
+// estimates, then rescores those exactly from the fp32 factors. The int8 path
+// also quantizes the query, so each movie costs an integer dot product and a
+// multiply by the two scales.
+void quant_search(const QuantCatalog *catalog, const Model *model,
+                  const float *profile, float bias, const int *excluded,
+                  int num_excluded, int rerank, TopK *topk) {
+  int n = catalog->num_movies, d = catalog->num_factors;
+  if (rerank < topk->capacity)
+    rerank = topk->capacity;
+
+  int8_t *query_codes = (int8_t *)calloc(catalog->padded_factors, 1);
+  float query_scale = quantize_row_int8(profile, d, query_codes);
+
+  Candidate *shortlist_items = (Candidate *)malloc(rerank * sizeof(Candidate));
+  TopK shortlist;
+  topk_init(&shortlist, shortlist_items, rerank);
+  float estimates[QUANT_NR];
+  int cursor = 0;
+  for (int p = 0; p < catalog->num_panels; p++) {
+    scan_panel(catalog, profile, query_codes, p, estimates);
+    if (catalog->precision == PRECISION_INT8) {
+      for (int i = 0; i < QUANT_NR; i++)
+        estimates[i] *= query_scale * catalog->scales[p * QUANT_NR + i];
+    }
+    int end = (p + 1) * QUANT_NR < n ? (p + 1) * QUANT_NR : n;
+    for (int j = p * QUANT_NR; j < end; j++) {
+      float estimate = estimates[j % QUANT_NR] + model->movie_bias[j];
+      if (shortlist.size == rerank && estimate < shortlist.items[0].score)
+        continue;
+      while (cursor < num_excluded && excluded[cursor] < j)
+        cursor++;
+      if (cursor < num_excluded && excluded[cursor] == j)
+        continue;
+      topk_push(&shortlist, estimate, j);
+    }
+  }
+
+  topk->size = 0;
+  float base = model->global_mean + bias;
+  for (int i = 0; i < shortlist.size; i++) {
+    int j = shortlist.items[i].id;
+    float score = base + model->movie_bias[j] +
+                  dot(profile, model->movie_features[j], d);
+    topk_push(topk, score, j);
+  }
+  topk_sort(topk);
+
+  free(query_codes);
+  free(shortlist_items);
+}
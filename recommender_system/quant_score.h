@@ -0,0 +1,39 @@
+#ifndef QUANT_SCORE_H
+#define QUANT_SCORE_H
+
+#include "data_structures.h"
+#include "model.h"
+#include "topk.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define QUANT_NR 16
+
+// Movie factors in a compact scan format, packed like ScoreCatalog into
+// factor-major panels of QUANT_NR movies. int8 panels interleave factor pairs
+// (k, k+1) per movie, padded to an even factor count, so one 16-bit multiply-
+// add covers two factors; each int8 movie carries one fp32 scale. The fp32
+// model is kept alongside for exact rescoring of the shortlist. Rows stored
+// at the scan precision are packed as they are instead of re-quantized.
+typedef struct {
+  Precision precision;
+  int num_movies;
+  int num_factors;
+  int padded_factors;
+  int num_panels;
+  int use_avx2;
+  float *rows;
+  uint16_t *halves;
+  int8_t *codes;
+  float *scales;
+} QuantCatalog;
+
+QuantCatalog *quant_catalog_create(const Model *model, Precision precision,
+                                   const ServingRows *stored);
+void quant_catalog_free(QuantCatalog *catalog);
+size_t quant_catalog_movie_bytes(const QuantCatalog *catalog);
+void quant_search(const QuantCatalog *catalog, const Model *model,
+                  const float *profile, float bias, const int *excluded,
+                  int num_excluded, int rerank, TopK *topk);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// IEEE binary16 conversion with round-to-nearest-even. Values too large for
+// half precision become infinity and values too small become zero or
+// subnormals.
+static inline uint16_t float_to_half(float value) {
+  uint32_t x;
+  memcpy(&x, &value, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000)
+    return (uint16_t)(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+  if (abs >= 0x477ff000)
+    return (uint16_t)(sign | 0x7c00);
+  if (abs < 0x38800000) {
+    if (abs < 0x33000000)
+      return (uint16_t)sign;
+    uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    uint32_t shift = 126 - (abs >> 23);
+    uint32_t h = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1)))
+      h++;
+    return (uint16_t)(sign | h);
+  }
+  uint32_t h = (abs >> 13) - (112 << 10);
+  uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+    h++;
+  return (uint16_t)(sign | h);
+}
+
+static inline float half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t x;
+  if (exponent == 0) {
+    float value = mantissa * (1.0f / 16777216.0f);
+    return sign ? -value : value;
+  }
+  if (exponent == 31)
+    x = sign | 0x7f800000 | (mantissa << 13);
+  else
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  float value;
+  memcpy(&value, &x, sizeof(value));
+  return value;
+}
+
+// Symmetric per-row int8: row[k] ~= scale * out[k]. Returns the scale, which
+// is 0 for an all-zero row.
+static inline float quantize_row_int8(const float *row, int n, int8_t *out) {
+  float max_abs = 0.0f;
+  for (int k = 0; k < n; k++) {
+    if (fabsf(row[k]) > max_abs)
+      max_abs = fabsf(row[k]);
+  }
+  float scale = max_abs / 127.0f;
+  float inverse = max_abs > 0.0f ? 127.0f / max_abs : 0.0f;
+  for (int k = 0; k < n; k++)
+    out[k] = (int8_t)lrintf(row[k] * inverse);
+  return scale;
+}
+
+#endif
@@ -1,41 +1,25 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "catalog.h"
 #include "config.h"
+#include "foldin.h"
+#include "mips_index.h"
 #include "model.h"
 #include "movies.h"
+#include "neighbors.h"
+#include "popularity.h"
+#include "quant_score.h"
+#include "score.h"
+#include "title_index.h"
+#include "topk.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-typedef struct {
-  float score;
-  int id;
-} Candidate;
-
-typedef struct {
-  int movie_id;
-  float rating;
-} UserRating;
-
-int compare_candidates(const void *a, const void *b) {
-  float sa = ((Candidate *)a)->score;
-  float sb = ((Candidate *)b)->score;
-  if (sa > sb)
-    return -1;
-  if (sa < sb)
-    return 1;
-  return 0;
-}
-
-static float predict_rating(Model *model, int user_id, int movie_id) {
-  float prediction = model->global_mean + model->user_bias[user_id] +
-                     model->movie_bias[movie_id];
-
-  for (int k = 0; k < model->num_factors; k++) {
-    prediction +=
-        model->user_features[user_id][k] * model->movie_features[movie_id][k];
-  }
-
+static float clamp_rating(float prediction) {
   if (prediction > 5.0)
     prediction = 5.0;
   if (prediction < 0.5)
@@ -44,105 +28,229 @@ static float predict_rating(Model *model, int user_id, int movie_id) {
   return prediction;
 }
 
-static void compute_user_profile(Model *model, UserRating *user_ratings,
-                                 int num_ratings, float *user_profile) {
-  // Initialize user profile to zeros
-  for (int k = 0; k < model->num_factors; k++) {
-    user_profile[k] = 0.0f;
-  }
-
-  // Use simple gradient descent to find user features that best fit the ratings
-  float learning_rate = 0.1f;
-  int iterations = 100;
-
-  for (int iter = 0; iter < iterations; iter++) {
-    for (int i = 0; i < num_ratings; i++) {
-      int movie_id = user_ratings[i].movie_id;
-      float actual_rating = user_ratings[i].rating;
-
-      // Predict rating with current user profile
-      float prediction = model->global_mean + model->movie_bias[movie_id];
-      for (int k = 0; k < model->num_factors; k++) {
-        prediction += user_profile[k] * model->movie_features[movie_id][k];
-      }
+static const char *display_title(const Catalog *catalog, int movie) {
+  const char *title = catalog_title(catalog, movie);
+  return title ? title : "(untitled)";
+}
 
-      // Compute error
-      float error = actual_rating - prediction;
+// Turns a comma-separated list of genre names into a bitmask, listing the
+// known genres if a name is not one of them.
+static int parse_genres(const Catalog *catalog, const char *list,
+                        uint64_t *mask) {
+  if (catalog_genre_mask(catalog, list, mask))
+    return 1;
+  printf("Unknown genre in '%s'. Known genres:", list);
+  for (int i = 0; i < catalog->num_genres; i++)
+    printf(" %s", catalog_genre_name(catalog, i));
+  printf("\n");
+  return 0;
+}
 
-      // Update user profile
-      for (int k = 0; k < model->num_factors; k++) {
-        user_profile[k] +=
-            learning_rate * error * model->movie_features[movie_id][k];
-      }
-    }
-    learning_rate *= 0.95f; // Decay learning rate
+// Answers "movies like X" from the precomputed neighbor table: the best title
+// match's row is read directly, with no scoring.
+static void show_similar(const Catalog *catalog, TitleIndex *title_index,
+                         const NeighborTable *neighbors, const char *query,
+                         int count) {
+  if (!neighbors) {
+    printf("  %s not loaded; run ./build_neighbors\n\n", NEIGHBORS_FILE);
+    return;
   }
+  int movie;
+  if (title_index_search(title_index, query, 1, &movie) == 0) {
+    printf("  No matching movies found.\n\n");
+    return;
+  }
+  if (count > neighbors->num_neighbors)
+    count = neighbors->num_neighbors;
+
+  const int32_t *ids = neighbor_ids(neighbors, movie);
+  const float *similarities = neighbor_similarities(neighbors, movie);
+  printf("\n  Movies similar to %s:\n", display_title(catalog, movie));
+  for (int i = 0; i < count && ids[i] >= 0; i++) {
+    printf("  %2d. %s (%.2f)\n", i + 1, display_title(catalog, ids[i]),
+           similarities[i]);
+  }
+  printf("\n");
 }
 
-static float predict_for_new_user(Model *model, float *user_profile,
-                                  int movie_id) {
-  float prediction = model->global_mean + model->movie_bias[movie_id];
-
-  for (int k = 0; k < model->num_factors; k++) {
-    prediction += user_profile[k] * model->movie_features[movie_id][k];
+// Cold-start answer: the precomputed popularity ranking, filtered by genre
+// and support, with no scoring.
+static void show_popular(const Catalog *catalog, const MovieStats *stats,
+                         uint64_t include_genres, uint64_t exclude_genres,
+                         int min_ratings, int count) {
+  int *movies = (int *)malloc(count * sizeof(int));
+  int found = movie_stats_top_k(stats, catalog->genre_masks, include_genres,
+                                exclude_genres, min_ratings, count, movies);
+  printf("\nNo movies rated. Most popular movies:\n\n");
+  if (found == 0)
+    printf("  No movies match the filters.\n\n");
+  for (int i = 0; i < found; i++) {
+    int mid = movies[i];
+    printf("  %2d. %s\n", i + 1, display_title(catalog, mid));
+    printf("      Average rating: %.2f from %d ratings\n", stats->means[mid],
+           stats->counts[mid]);
+    if (catalog_genres(catalog, mid))
+      printf("      Genres: %s\n", catalog_genres(catalog, mid));
+    printf("\n");
   }
+  free(movies);
+}
 
-  if (prediction > 5.0)
-    prediction = 5.0;
-  if (prediction < 0.5)
-    prediction = 0.5;
-
-  return prediction;
+static long long mtime_ns(const char *filename) {
+  struct stat st;
+  if (stat(filename, &st) != 0)
+    return 0;
+  return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
 }
 
-int main() {
+int main(int argc, char **argv) {
+  int top_k = TOP_K;
+  int nprobe = ANN_NPROBE;
+  int rerank = ANN_RERANK;
+  int exact = 0;
+  int quantized = 0;
+  int min_ratings = 0;
+  Precision scan_precision = PRECISION_INT8;
+  char *include_list = NULL;
+  char *exclude_list = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--genre") == 0 && i + 1 < argc) {
+      include_list = argv[++i];
+    } else if (strcmp(argv[i], "--exclude-genre") == 0 && i + 1 < argc) {
+      exclude_list = argv[++i];
+    } else if (strcmp(argv[i], "--nprobe") == 0 && i + 1 < argc) {
+      nprobe = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rerank") == 0 && i + 1 < argc) {
+      rerank = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--min-ratings") == 0 && i + 1 < argc) {
+      min_ratings = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--exact") == 0) {
+      exact = 1;
+    } else if (strcmp(argv[i], "--quantized") == 0 && i + 1 < argc &&
+               parse_precision(argv[i + 1], &scan_precision)) {
+      quantized = 1;
+      i++;
+    } else if (argv[i][0] != '-') {
+      top_k = atoi(argv[i]);
+    } else {
+      printf("Usage: %s [num_recommendations] [--genre A,B] "
+             "[--exclude-genre C,D] [--nprobe N] [--rerank R] [--exact] "
+             "[--quantized fp32|fp16|int8] [--min-ratings N]\n",
+             argv[0]);
+      return 1;
+    }
+  }
+  if (top_k <= 0)
+    top_k = TOP_K;
+  if (nprobe <= 0)
+    nprobe = ANN_NPROBE;
+
   char cwd[1024];
   if (getcwd(cwd, sizeof(cwd)) != NULL) {
     printf("Current working directory: %s\n", cwd);
   }
 
-  FILE *test = fopen("model.bin", "rb");
+  FILE *test = fopen(SERVING_FILE, "rb");
   if (test) {
-    printf("model.bin can be opened for reading\n");
+    printf("%s can be opened for reading\n", SERVING_FILE);
     fclose(test);
   } else {
-    printf("✗ Cannot open model.bin\n");
+    printf("✗ Cannot open %s; run train_save to create it\n", SERVING_FILE);
     perror("fopen");
     return 1;
   }
 
-  printf("Loading model\n");
-  Model *model = load_model("model.bin");
+  // Only the movie side of the model is needed: the user's profile is folded
+  // in from their ratings, so the trained user factors are never loaded.
+  printf("Loading serving model\n");
+  Precision precision;
+  ServingRows stored = {NULL, NULL, NULL};
+  Model *model = load_serving_model(SERVING_FILE, &precision,
+                                    quantized ? &stored : NULL);
   if (!model) {
     printf("Failed to load model\n");
     return 1;
   }
-  printf("Model loaded: %d users, %d movies, %d factors\n", model->num_users,
-         model->num_movies, model->num_factors);
+  printf("Model loaded: %d movies, %d factors (%s)\n", model->num_movies,
+         model->num_factors, precision_name(precision));
   printf("Global mean: %.4f\n", model->global_mean);
 
-  int num_movies;
-  int *original_ids = load_movie_mapping("movie_mapping.bin", &num_movies);
-  printf("Loaded mapping for %d movies\n", num_movies);
+  // Built once, from the file's own rows when they are already stored at the
+  // scan precision.
+  QuantCatalog *quant = NULL;
+  if (quantized) {
+    quant = quant_catalog_create(model, scan_precision, &stored);
+    free_serving_rows(&stored);
+    printf("Quantized scan: %s%s\n", precision_name(scan_precision),
+           scan_precision == precision ? " rows from " SERVING_FILE : "");
+  }
 
-  int max_orig = 0;
-  for (int i = 0; i < num_movies; i++) {
-    if (original_ids[i] > max_orig)
-      max_orig = original_ids[i];
+  // As in recommend_server, an index written before the model was built from
+  // older factors and is skipped.
+  MipsIndex *index = exact || quantized ? NULL : mips_index_load(INDEX_FILE);
+  if (index && mtime_ns(INDEX_FILE) < mtime_ns(SERVING_FILE)) {
+    printf("%s is older than %s; run ./build_index. Using exact scoring\n",
+           INDEX_FILE, SERVING_FILE);
+    mips_index_free(index);
+    index = NULL;
+  }
+  if (index && (index->num_movies != model->num_movies ||
+                index->num_factors != model->num_factors)) {
+    printf("%s does not match %s; using exact scoring\n", INDEX_FILE,
+           SERVING_FILE);
+    mips_index_free(index);
+    index = NULL;
+  }
+  if (index) {
+    printf("Using %s: %d lists, nprobe %d, rerank %d\n", INDEX_FILE,
+           index->num_lists, nprobe, rerank);
+  }
+
+  // The catalog must be built against the same movie mapping as the model,
+  // or every title and genre would be shown for the wrong movie.
+  int num_mapped = 0;
+  int *mapping = load_movie_mapping(MAPPING_FILE, &num_mapped);
+  Catalog *catalog = catalog_open(CATALOG_FILE);
+  int matches = catalog && mapping && num_mapped == model->num_movies &&
+                catalog_matches(catalog, mapping, num_mapped);
+  free(mapping);
+  if (!matches) {
+    printf("%s is missing or does not match %s; run ./build_catalog\n",
+           CATALOG_FILE, MAPPING_FILE);
+    catalog_close(catalog);
+    mips_index_free(index);
+    quant_catalog_free(quant);
+    free_model(model);
+    return 1;
+  }
+  int num_movies = catalog->num_movies;
+  printf("Loaded catalog for %d movies\n", num_movies);
+
+  uint64_t include_genres = 0, exclude_genres = 0;
+  if ((include_list && !parse_genres(catalog, include_list, &include_genres)) ||
+      (exclude_list && !parse_genres(catalog, exclude_list, &exclude_genres))) {
+    catalog_close(catalog);
+    mips_index_free(index);
+    quant_catalog_free(quant);
+    free_model(model);
+    return 1;
   }
-  int *remap_table = (int *)malloc((max_orig + 1) * sizeof(int));
-  for (int j = 0; j <= max_orig; j++)
-    remap_table[j] = -1;
-  for (int i = 0; i < num_movies; i++) {
-    remap_table[original_ids[i]] = i;
+
+  NeighborTable *neighbors = neighbors_open(NEIGHBORS_FILE);
+  if (neighbors && neighbors->num_movies != num_movies) {
+    printf("%s does not match %s; run ./build_neighbors\n", NEIGHBORS_FILE,
+           SERVING_FILE);
+    neighbors_close(neighbors);
+    neighbors = NULL;
   }
 
-  Movie *movies = (Movie *)malloc(num_movies * sizeof(Movie));
-  for (int i = 0; i < num_movies; i++) {
-    movies[i].title = NULL;
-    movies[i].genres = NULL;
+  MovieStats *stats = load_movie_stats(MOVIE_STATS_FILE, num_movies);
+  if (min_ratings > 0 && !stats) {
+    printf("%s not loaded; ignoring --min-ratings\n", MOVIE_STATS_FILE);
+    min_ratings = 0;
   }
-  load_movies(movies, num_movies, "data/movies.csv", remap_table, max_orig);
+  TitleIndex *title_index =
+      title_index_build(catalog, stats ? stats->counts : NULL);
 
   bool *picked = (bool *)calloc(num_movies, sizeof(bool));
   UserRating *user_ratings = NULL;
@@ -153,7 +261,8 @@ int main() {
   printf("═══════════════════════════════════════════════════════════\n\n");
   printf("Enter movie titles and rate them (0.5 - 5.0 stars).\n");
   printf("Type 'done' when ready for recommendations.\n");
-  printf("Type 'list' to see your rated movies.\n\n");
+  printf("Type 'list' to see your rated movies.\n");
+  printf("Type 'similar <title>' to see movies like it.\n\n");
 
   char input[256];
   while (1) {
@@ -172,7 +281,7 @@ int main() {
         printf("\n  Your rated movies:\n");
         for (int i = 0; i < num_user_ratings; i++) {
           int mid = user_ratings[i].movie_id;
-          printf("  %d. %s - %.1f stars\n", i + 1, movies[mid].title,
+          printf("  %d. %s - %.1f stars\n", i + 1, display_title(catalog, mid),
                  user_ratings[i].rating);
         }
         printf("\n");
@@ -180,9 +289,14 @@ int main() {
       continue;
     }
 
-    int *matches = NULL;
-    int num_matches = 0;
-    search_titles(movies, num_movies, input, &matches, &num_matches);
+    if (strncmp(input, "similar ", 8) == 0) {
+      show_similar(catalog, title_index, neighbors, input + 8, top_k);
+      continue;
+    }
+
+    int matches[TITLE_MAX_RESULTS];
+    int num_matches =
+        title_index_search(title_index, input, TITLE_MAX_RESULTS, matches);
 
     if (num_matches == 0) {
       printf("  No matching movies found.\n\n");
@@ -195,14 +309,13 @@ int main() {
       selected_movie = matches[0];
       if (picked[selected_movie]) {
         printf("  Already rated this movie.\n\n");
-        free(matches);
         continue;
       }
-      printf("  Found: %s\n", movies[selected_movie].title);
+      printf("  Found: %s\n", display_title(catalog, selected_movie));
     } else {
       printf("\n  Found %d matching movies:\n", num_matches);
       for (int i = 0; i < num_matches; i++) {
-        printf("  %d. %s\n", i + 1, movies[matches[i]].title);
+        printf("  %d. %s\n", i + 1, display_title(catalog, matches[i]));
       }
 
       int choice;
@@ -214,7 +327,6 @@ int main() {
           int c;
           while ((c = getchar()) != '\n' && c != EOF)
             ;
-          free(matches);
           continue;
         }
       } else if (choice == 0) {
@@ -222,14 +334,12 @@ int main() {
         int c;
         while ((c = getchar()) != '\n' && c != EOF)
           ;
-        free(matches);
         continue;
       } else {
         printf("  Invalid choice.\n\n");
         int c;
         while ((c = getchar()) != '\n' && c != EOF)
           ;
-        free(matches);
         continue;
       }
       int c;
@@ -237,8 +347,6 @@ int main() {
         ;
     }
 
-    free(matches);
-
     // Get rating for the selected movie
     float rating;
     printf("  Rate this movie (0.5 - 5.0): ");
@@ -255,8 +363,8 @@ int main() {
       user_ratings[num_user_ratings].rating = rating;
       num_user_ratings++;
 
-      printf("  ✓ Added: %s - %.1f stars\n\n", movies[selected_movie].title,
-             rating);
+      printf("  ✓ Added: %s - %.1f stars\n\n",
+             display_title(catalog, selected_movie), rating);
     } else {
       printf("  Invalid rating.\n\n");
     }
@@ -267,17 +375,19 @@ int main() {
   }
 
   if (num_user_ratings == 0) {
-    printf("\nNo movies rated. Exiting.\n");
-    free(original_ids);
-    free(remap_table);
-    for (int i = 0; i < num_movies; i++) {
-      if (movies[i].title)
-        free(movies[i].title);
-      if (movies[i].genres)
-        free(movies[i].genres);
+    if (stats) {
+      show_popular(catalog, stats, include_genres, exclude_genres,
+                   min_ratings, top_k);
+    } else {
+      printf("\nNo movies rated. Exiting.\n");
     }
-    free(movies);
+    movie_stats_free(stats);
+    title_index_free(title_index);
+    neighbors_close(neighbors);
+    catalog_close(catalog);
     free(picked);
+    mips_index_free(index);
+    quant_catalog_free(quant);
     free_model(model);
     return 0;
   }
@@ -286,41 +396,65 @@ int main() {
   printf("Computing personalized recommendations...\n");
   printf("═══════════════════════════════════════════════════════════\n\n");
 
-  // Compute user profile based on rated movies
+  // Fold the new user into the trained factor space
   float *user_profile = (float *)malloc(model->num_factors * sizeof(float));
-  compute_user_profile(model, user_ratings, num_user_ratings, user_profile);
+  float user_bias;
+  fold_in_user(model, user_ratings, num_user_ratings, FOLDIN_REGULARIZATION,
+               user_profile, &user_bias);
 
-  // Generate recommendations
-  Candidate *candidates = (Candidate *)malloc(num_movies * sizeof(Candidate));
-  int cand_count = 0;
+  // Score the catalog, keeping only the best top_k as we go
+  int *excluded = (int *)malloc(num_movies * sizeof(int));
+  int num_excluded = 0;
   for (int j = 0; j < num_movies; j++) {
-    if (picked[j] || !movies[j].title)
-      continue;
-
-    float score = predict_for_new_user(model, user_profile, j);
-
-    candidates[cand_count].score = score;
-    candidates[cand_count].id = j;
-    cand_count++;
+    if (picked[j] || !catalog_title(catalog, j) ||
+        (min_ratings > 0 && stats->counts[j] < min_ratings))
+      excluded[num_excluded++] = j;
   }
 
-  qsort(candidates, cand_count, sizeof(Candidate), compare_candidates);
+  Candidate *candidates = (Candidate *)malloc(top_k * sizeof(Candidate));
+  TopK topk;
+  topk_init(&topk, candidates, top_k);
+  // The index and the quantized scan have no genre information, so filtered
+  // requests are scored exactly with the filter pushed into the scan.
+  int filtered = include_genres || exclude_genres;
+  if (quant && !filtered) {
+    quant_search(quant, model, user_profile, user_bias, excluded,
+                 num_excluded, rerank, &topk);
+  } else if (index && !filtered) {
+    mips_index_search(index, model, user_profile, user_bias, excluded,
+                      num_excluded, nprobe, rerank, &topk);
+  } else {
+    ScoreCatalog *packed =
+        score_catalog_create(model->movie_feature_data, model->movie_bias,
+                             model->global_mean, model->num_movies,
+                             model->num_factors);
+    score_catalog_set_genres(packed, catalog->genre_masks,
+                             catalog->num_genres);
+    if (include_genres)
+      score_catalog_pack_genres(packed);
+    ScoreRequest request = {user_profile, user_bias, excluded, num_excluded,
+                            &topk, include_genres, exclude_genres};
+    score_topk_batch(packed, &request, 1);
+    score_catalog_free(packed);
+  }
+  free(excluded);
 
   printf("Based on your ratings:\n");
   for (int i = 0; i < num_user_ratings; i++) {
     int mid = user_ratings[i].movie_id;
-    printf("  • %s - %.1f stars\n", movies[mid].title, user_ratings[i].rating);
+    printf("  • %s - %.1f stars\n", display_title(catalog, mid),
+           user_ratings[i].rating);
   }
   printf("\n");
 
-  printf("Top 10 Recommendations:\n\n");
-  int top_n = (cand_count < 10) ? cand_count : 10;
-  for (int i = 0; i < top_n; i++) {
+  printf("Top %d Recommendations:\n\n", top_k);
+  for (int i = 0; i < topk.size; i++) {
     int mid = candidates[i].id;
-    printf("  %2d. %s\n", i + 1, movies[mid].title);
-    printf("      Predicted rating: %.2f ⭐\n", candidates[i].score);
-    if (movies[mid].genres) {
-      printf("      Genres: %s\n", movies[mid].genres);
+    printf("  %2d. %s\n", i + 1, display_title(catalog, mid));
+    printf("      Predicted rating: %.2f ⭐\n",
+           clamp_rating(candidates[i].score));
+    if (catalog_genres(catalog, mid)) {
+      printf("      Genres: %s\n", catalog_genres(catalog, mid));
     }
     printf("\n");
   }
@@ -329,15 +463,12 @@ int main() {
   free(candidates);
   free(user_ratings);
   free(picked);
-  for (int i = 0; i < num_movies; i++) {
-    if (movies[i].title)
-      free(movies[i].title);
-    if (movies[i].genres)
-      free(movies[i].genres);
-  }
-  free(movies);
-  free(remap_table);
-  free(original_ids);
+  movie_stats_free(stats);
+  title_index_free(title_index);
+  neighbors_close(neighbors);
+  catalog_close(catalog);
+  mips_index_free(index);
+  quant_catalog_free(quant);
   free_model(model);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,475 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "config.h"
+#include "foldin.h"
+#include "model.h"
+#include "model_io.h"
+#include "movies.h"
+#include "score.h"
+#include "topk.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <mpi.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Requests read by rank 0 for one round. Request r rated movies[offsets[r]
+// .. offsets[r+1]) (model IDs), wants ks[r] items and was read at
+// read_times[r]; errors[r] is set if the line was rejected.
+typedef struct {
+  int count;
+  int max_k;
+  int *ks;
+  int *offsets;
+  int *movies;
+  float *ratings;
+  double *read_times;
+  const char **errors;
+  int ratings_capacity;
+} Batch;
+
+// Buffered line reader over a file descriptor. Unlike stdio it can tell
+// whether another line is available without blocking.
+typedef struct {
+  int fd;
+  int eof;
+  char *data;
+  size_t start;
+  size_t end;
+  size_t capacity;
+} LineReader;
+
+static void reader_init(LineReader *reader, int fd) {
+  reader->fd = fd;
+  reader->eof = 0;
+  reader->capacity = 4096;
+  reader->data = (char *)malloc(reader->capacity);
+  reader->start = reader->end = 0;
+}
+
+// Returns the next line without its newline, valid until the next call, or
+// NULL at end of input. Without wait, also returns NULL if no complete line
+// is buffered and the descriptor has nothing to read right now.
+static char *next_line(LineReader *reader, int wait) {
+  while (1) {
+    char *begin = reader->data + reader->start;
+    size_t pending = reader->end - reader->start;
+    char *newline = (char *)memchr(begin, '\n', pending);
+    if (newline || (reader->eof && pending > 0)) {
+      size_t len = newline ? (size_t)(newline - begin) : pending;
+      begin[len] = '\0';
+      reader->start += len + (newline != NULL);
+      return begin;
+    }
+    if (reader->eof)
+      return NULL;
+    if (!wait) {
+      struct pollfd pfd = {reader->fd, POLLIN, 0};
+      if (poll(&pfd, 1, 0) <= 0)
+        return NULL;
+    }
+
+    memmove(reader->data, begin, pending);
+    reader->end = pending;
+    reader->start = 0;
+    if (reader->end + 1 == reader->capacity) {
+      reader->capacity *= 2;
+      reader->data = (char *)realloc(reader->data, reader->capacity);
+    }
+    ssize_t n = read(reader->fd, reader->data + reader->end,
+                     reader->capacity - reader->end - 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      reader->eof = 1;
+    else
+      reader->end += n;
+  }
+}
+
+static void batch_init(Batch *batch, int capacity) {
+  batch->ks = (int *)malloc(capacity * sizeof(int));
+  batch->read_times = (double *)malloc(capacity * sizeof(double));
+  batch->offsets = (int *)malloc((capacity + 1) * sizeof(int));
+  batch->errors = (const char **)malloc(capacity * sizeof(char *));
+  batch->ratings_capacity = 1024;
+  batch->movies = (int *)malloc(batch->ratings_capacity * sizeof(int));
+  batch->ratings = (float *)malloc(batch->ratings_capacity * sizeof(float));
+}
+
+static void batch_free(Batch *batch) {
+  free(batch->ks);
+  free(batch->read_times);
+  free(batch->offsets);
+  free(batch->errors);
+  free(batch->movies);
+  free(batch->ratings);
+}
+
+// Same line format as recommend_server: REC <k> <movieId>:<rating> ...
+// Unknown movies are ignored. The caller drops the ratings of a rejected line.
+static const char *parse_request(char *line, const int *remap, int max_id,
+                                 Batch *batch, int *k_out) {
+  char *cursor = line;
+  if (strncmp(cursor, "REC ", 4) != 0)
+    return "unknown command";
+  cursor += 4;
+
+  char *end;
+  long k = strtol(cursor, &end, 10);
+  if (end == cursor || k <= 0)
+    return "bad k";
+  *k_out = (int)k;
+  cursor = end;
+
+  int *count = &batch->offsets[batch->count + 1];
+  while (1) {
+    long id = strtol(cursor, &end, 10);
+    if (end == cursor)
+      break;
+    cursor = end;
+    if (*cursor != ':')
+      return "expected movieId:rating";
+    cursor++;
+    float rating = strtof(cursor, &end);
+    if (end == cursor)
+      return "bad rating";
+    cursor = end;
+    if (id < 0 || id > max_id || remap[id] < 0)
+      continue;
+
+    if (*count == batch->ratings_capacity) {
+      batch->ratings_capacity *= 2;
+      batch->movies = (int *)realloc(batch->movies,
+                                     batch->ratings_capacity * sizeof(int));
+      batch->ratings = (float *)realloc(
+          batch->ratings, batch->ratings_capacity * sizeof(float));
+    }
+    batch->movies[*count] = remap[id];
+    batch->ratings[*count] = rating < 0.5f ? 0.5f : (rating > 5.0f ? 5.0f
+                                                                   : rating);
+    (*count)++;
+  }
+  if (*count == batch->offsets[batch->count])
+    return "no known movies rated";
+  return NULL;
+}
+
+// Waits for one request, then takes the ones already waiting, up to
+// capacity, so a lone request is not held back for a full batch.
+static int read_batch(LineReader *in, int capacity, const int *remap,
+                      int max_id, int num_movies, Batch *batch) {
+  batch->count = 0;
+  batch->max_k = 0;
+  batch->offsets[0] = 0;
+  char *line;
+  while (batch->count < capacity &&
+         (line = next_line(in, batch->count == 0))) {
+    int r = batch->count;
+    int k = 0;
+    batch->read_times[r] = MPI_Wtime();
+    batch->offsets[r + 1] = batch->offsets[r];
+    batch->errors[r] = parse_request(line, remap, max_id, batch, &k);
+    if (batch->errors[r])
+      batch->offsets[r + 1] = batch->offsets[r];
+    batch->ks[r] = k < num_movies ? k : num_movies;
+    if (!batch->errors[r] && batch->ks[r] > batch->max_k)
+      batch->max_k = batch->ks[r];
+    batch->count++;
+  }
+  return batch->count;
+}
+
+// MPI reduction operator merging best-first top-K lists element-wise. MPI
+// applies it along its reduction tree, so each list is merged log2(ranks)
+// times on the way to rank 0 instead of rank 0 merging every shard.
+static void merge_lists(void *in, void *inout, int *len, MPI_Datatype *type) {
+  int bytes;
+  MPI_Type_size(*type, &bytes);
+  int k = bytes / (int)sizeof(Candidate);
+  Candidate *merged = (Candidate *)malloc(k * sizeof(Candidate));
+  for (int l = 0; l < *len; l++) {
+    const Candidate *a = (const Candidate *)in + (size_t)l * k;
+    Candidate *b = (Candidate *)inout + (size_t)l * k;
+    int i = 0, j = 0;
+    for (int r = 0; r < k; r++) {
+      if (candidate_better(a[i].score, a[i].id, b[j].score, b[j].id))
+        merged[r] = a[i++];
+      else
+        merged[r] = b[j++];
+    }
+    memcpy(b, merged, k * sizeof(Candidate));
+  }
+  free(merged);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static float clamp_rating(float prediction) {
+  if (prediction > 5.0f)
+    prediction = 5.0f;
+  if (prediction < 0.5f)
+    prediction = 0.5f;
+  return prediction;
+}
+
+int main(int argc, char **argv) {
+  int rank, size;
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  const char *input_file = NULL;
+  const char *model_file = MODEL_FILE;
+  int batch_size = SHARD_BATCH;
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      input_file = argv[++i];
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      model_file = argv[++i];
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      batch_size = atoi(argv[++i]);
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || batch_size <= 0) {
+    if (rank == 0) {
+      printf("Usage: %s [-i requests.txt] [-m model.bin] [-b batch]\n",
+             argv[0]);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+
+  int movie_start, num_movies;
+  Model *shard = load_model_shard(model_file, rank, size, &movie_start,
+                                  &num_movies);
+  if (!shard)
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  int local_movies = shard->num_movies;
+  int movie_end = movie_start + local_movies;
+  int d = shard->num_factors;
+  ScoreCatalog *catalog =
+      score_catalog_create(shard->movie_feature_data, shard->movie_bias,
+                           shard->global_mean, local_movies, d);
+
+  LineReader in;
+  reader_init(&in, STDIN_FILENO);
+  int *original_ids = NULL;
+  int *remap = NULL;
+  int max_id = 0;
+  if (rank == 0) {
+    int num_ids;
+    original_ids = load_movie_mapping(MAPPING_FILE, &num_ids);
+    if (!original_ids || num_ids != num_movies) {
+      fprintf(stderr, "Error: %s does not match %s\n", MAPPING_FILE,
+              model_file);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int j = 0; j < num_ids; j++)
+      if (original_ids[j] > max_id)
+        max_id = original_ids[j];
+    remap = (int *)malloc((max_id + 1) * sizeof(int));
+    for (int i = 0; i <= max_id; i++)
+      remap[i] = -1;
+    for (int j = 0; j < num_ids; j++)
+      remap[original_ids[j]] = j;
+
+    if (input_file && (in.fd = open(input_file, O_RDONLY)) < 0) {
+      fprintf(stderr, "Error opening %s\n", input_file);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    fprintf(stderr, "Serving %d movies in %d shards of about %d\n",
+            num_movies, size, local_movies);
+  }
+
+  MPI_Op merge_op;
+  MPI_Op_create(merge_lists, 1, &merge_op);
+
+  Batch batch;
+  batch_init(&batch, batch_size);
+  int latency_capacity = 1024, num_batches = 0, num_requests = 0;
+  double *latencies = (double *)malloc(latency_capacity * sizeof(double));
+
+  while (1) {
+    // Round header: request count, total ratings and the largest K.
+    int meta[3] = {0, 0, 0};
+    if (rank == 0) {
+      read_batch(&in, batch_size, remap, max_id, num_movies, &batch);
+      meta[0] = batch.count;
+      meta[1] = batch.offsets[batch.count];
+      meta[2] = batch.max_k;
+    }
+    MPI_Bcast(meta, 3, MPI_INT, 0, MPI_COMM_WORLD);
+    int count = meta[0], total = meta[1], k = meta[2] > 0 ? meta[2] : 1;
+    if (count == 0)
+      break;
+
+    if (rank != 0)
+      batch.movies = (int *)realloc(batch.movies, (total + 1) * sizeof(int));
+    MPI_Bcast(batch.offsets, count + 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(batch.movies, total, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // Fold-in needs the rated movies' rows, which live on their owners.
+    // Every rated movie is owned by exactly one rank, so a sum reduction
+    // assembles [factors, bias] for all of them on rank 0.
+    int stride = d + 1;
+    float *rows = (float *)calloc((size_t)(total + 1) * stride, sizeof(float));
+    for (int t = 0; t < total; t++) {
+      int j = batch.movies[t];
+      if (j < movie_start || j >= movie_end)
+        continue;
+      memcpy(rows + (size_t)t * stride,
+             shard->movie_features[j - movie_start], d * sizeof(float));
+      rows[(size_t)t * stride + d] = shard->movie_bias[j - movie_start];
+    }
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : rows, rows, total * stride,
+               MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Profiles followed by biases, solved on rank 0 and broadcast.
+    float *profiles = (float *)malloc((size_t)count * stride * sizeof(float));
+    float *biases = profiles + (size_t)count * d;
+    if (rank == 0) {
+      float **row_ptrs = (float **)malloc((total + 1) * sizeof(float *));
+      float *row_bias = (float *)malloc((total + 1) * sizeof(float));
+      UserRating *ratings =
+          (UserRating *)malloc((total + 1) * sizeof(UserRating));
+      for (int t = 0; t < total; t++) {
+        row_ptrs[t] = rows + (size_t)t * stride;
+        row_bias[t] = rows[(size_t)t * stride + d];
+        ratings[t].movie_id = t;
+        ratings[t].rating = batch.ratings[t];
+      }
+      Model gathered;
+      memset(&gathered, 0, sizeof(gathered));
+      gathered.movie_features = row_ptrs;
+      gathered.movie_bias = row_bias;
+      gathered.global_mean = shard->global_mean;
+      gathered.num_movies = total;
+      gathered.num_factors = d;
+      fold_in_users(&gathered, batch.offsets, ratings, count,
+                    FOLDIN_REGULARIZATION, profiles, biases);
+      free(row_ptrs);
+      free(row_bias);
+      free(ratings);
+    }
+    MPI_Bcast(profiles, count * stride, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    free(rows);
+
+    // Local top-K over this shard, excluding the rated movies it owns.
+    int *excluded = (int *)malloc((total + 1) * sizeof(int));
+    Candidate *lists =
+        (Candidate *)malloc((size_t)count * k * sizeof(Candidate));
+    TopK *topks = (TopK *)malloc(count * sizeof(TopK));
+    ScoreRequest *requests =
+        (ScoreRequest *)calloc(count, sizeof(ScoreRequest));
+    int local_k = k < local_movies ? k : local_movies;
+    for (int r = 0; r < count; r++) {
+      int *own = excluded + batch.offsets[r];
+      int num_own = 0;
+      for (int t = batch.offsets[r]; t < batch.offsets[r + 1]; t++) {
+        int j = batch.movies[t];
+        if (j >= movie_start && j < movie_end)
+          own[num_own++] = j - movie_start;
+      }
+      qsort(own, num_own, sizeof(int), compare_ints);
+      topk_init(&topks[r], lists + (size_t)r * k, local_k);
+      requests[r].profile = profiles + (size_t)r * d;
+      requests[r].bias = biases[r];
+      requests[r].excluded = own;
+      requests[r].num_excluded = num_own;
+      requests[r].topk = &topks[r];
+    }
+    score_topk_batch(catalog, requests, count);
+    for (int r = 0; r < count; r++) {
+      Candidate *list = lists + (size_t)r * k;
+      for (int i = 0; i < k; i++) {
+        if (i < topks[r].size) {
+          list[i].id += movie_start;
+        } else {
+          list[i].score = -INFINITY;
+          list[i].id = -1;
+        }
+      }
+    }
+
+    MPI_Datatype list_type;
+    MPI_Type_contiguous(k * (int)sizeof(Candidate), MPI_BYTE, &list_type);
+    MPI_Type_commit(&list_type);
+    Candidate *merged =
+        rank == 0 ? (Candidate *)malloc((size_t)count * k * sizeof(Candidate))
+                  : NULL;
+    MPI_Reduce(lists, merged, count, list_type, merge_op, 0, MPI_COMM_WORLD);
+    MPI_Type_free(&list_type);
+
+    if (rank == 0) {
+      for (int r = 0; r < count; r++) {
+        if (batch.errors[r]) {
+          printf("ERR %s\n", batch.errors[r]);
+          continue;
+        }
+        const Candidate *list = merged + (size_t)r * k;
+        int n = 0;
+        while (n < batch.ks[r] && list[n].id >= 0)
+          n++;
+        printf("OK %d", n);
+        for (int i = 0; i < n; i++) {
+          printf(" %d %.4f", original_ids[list[i].id],
+                 clamp_rating(list[i].score));
+        }
+        printf("\n");
+      }
+      fflush(stdout);
+      double done = MPI_Wtime();
+      if (num_requests + count > latency_capacity) {
+        while (num_requests + count > latency_capacity)
+          latency_capacity *= 2;
+        latencies = (double *)realloc(latencies,
+                                      latency_capacity * sizeof(double));
+      }
+      for (int r = 0; r < count; r++)
+        latencies[num_requests++] = done - batch.read_times[r];
+      num_batches++;
+    }
+
+    free(merged);
+    free(requests);
+    free(topks);
+    free(lists);
+    free(excluded);
+    free(profiles);
+  }
+
+  if (rank == 0 && num_requests > 0) {
+    qsort(latencies, num_requests, sizeof(double), compare_doubles);
+    fprintf(stderr,
+            "Served %d requests in %d rounds on %d ranks; request latency "
+            "p50: %.3f ms, p99: %.3f ms\n",
+            num_requests, num_batches, size,
+            1e3 * latencies[num_requests / 2],
+            1e3 * latencies[(long long)num_requests * 99 / 100]);
+  }
+
+  if (in.fd != STDIN_FILENO)
+    close(in.fd);
+  free(in.data);
+  free(latencies);
+  free(remap);
+  free(original_ids);
+  batch_free(&batch);
+  MPI_Op_free(&merge_op);
+  score_catalog_free(catalog);
+  free_model(shard);
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,380 @@
+#include "recsys.h"
+#include "catalog.h"
+#include "config.h"
+#include "foldin.h"
+#include "model.h"
+#include "score.h"
+#include "topk.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct RecsysModel {
+  Model *model;
+  ScoreCatalog *catalog;
+  Catalog *genres;
+  int *movie_ids;
+  int *internal_ids;
+  int max_movie_id;
+};
+
+static int *read_mapping(const char *filename, int *num_out) {
+  FILE *f = fopen(filename, "rb");
+  if (!f)
+    return NULL;
+  int num;
+  int *ids = NULL;
+  if (fread(&num, sizeof(int), 1, f) == 1 && num > 0) {
+    ids = (int *)malloc(num * sizeof(int));
+    if (ids && fread(ids, sizeof(int), num, f) != (unsigned)num) {
+      free(ids);
+      ids = NULL;
+    }
+  }
+  fclose(f);
+  *num_out = ids ? num : 0;
+  return ids;
+}
+
+static int internal_id(const RecsysModel *model, int movie_id) {
+  if (movie_id < 0 || movie_id > model->max_movie_id)
+    return -1;
+  return model->internal_ids[movie_id];
+}
+
+RecsysStatus recsys_load(const char *serving_file, const char *mapping_file,
+                         RecsysModel **out) {
+  if (!serving_file || !mapping_file || !out)
+    return RECSYS_ERR_ARGUMENT;
+  *out = NULL;
+
+  FILE *f = fopen(serving_file, "rb");
+  if (!f)
+    return RECSYS_ERR_IO;
+  Precision precision;
+  Model *model = read_serving_model(f, &precision, NULL);
+  fclose(f);
+  if (!model)
+    return RECSYS_ERR_FORMAT;
+
+  int num_ids;
+  int *movie_ids = read_mapping(mapping_file, &num_ids);
+  if (!movie_ids || num_ids != model->num_movies) {
+    free(movie_ids);
+    free_model(model);
+    return movie_ids ? RECSYS_ERR_FORMAT : RECSYS_ERR_IO;
+  }
+
+  int max_id = 0;
+  for (int j = 0; j < num_ids; j++) {
+    if (movie_ids[j] < 0) {
+      free(movie_ids);
+      free_model(model);
+      return RECSYS_ERR_FORMAT;
+    }
+    if (movie_ids[j] > max_id)
+      max_id = movie_ids[j];
+  }
+  int *internal_ids = (int *)malloc(((size_t)max_id + 1) * sizeof(int));
+  if (!internal_ids) {
+    free(movie_ids);
+    free_model(model);
+    return RECSYS_ERR_FORMAT;
+  }
+  for (int i = 0; i <= max_id; i++)
+    internal_ids[i] = -1;
+  for (int j = 0; j < num_ids; j++)
+    internal_ids[movie_ids[j]] = j;
+
+  RecsysModel *recsys = (RecsysModel *)calloc(1, sizeof(RecsysModel));
+  recsys->model = model;
+  recsys->catalog = score_catalog_create(
+      model->movie_feature_data, model->movie_bias, model->global_mean,
+      model->num_movies, model->num_factors);
+  recsys->movie_ids = movie_ids;
+  recsys->internal_ids = internal_ids;
+  recsys->max_movie_id = max_id;
+  *out = recsys;
+  return RECSYS_OK;
+}
+
+void recsys_free(RecsysModel *model) {
+  if (!model)
+    return;
+  score_catalog_free(model->catalog);
+  catalog_close(model->genres);
+  free_model(model->model);
+  free(model->movie_ids);
+  free(model->internal_ids);
+  free(model);
+}
+
+const char *recsys_status_string(RecsysStatus status) {
+  switch (status) {
+  case RECSYS_OK:
+    return "ok";
+  case RECSYS_ERR_IO:
+    return "cannot open model files";
+  case RECSYS_ERR_FORMAT:
+    return "model files are corrupt or do not match";
+  case RECSYS_ERR_ARGUMENT:
+    return "invalid argument";
+  case RECSYS_ERR_NO_RATINGS:
+    return "no rated movie is in the model";
+  case RECSYS_ERR_SOLVE:
+    return "fold-in solve failed";
+  case RECSYS_ERR_GENRE:
+    return "unknown genre or no genres loaded";
+  }
+  return "unknown status";
+}
+
+// The catalog must list the model's movies in the model's order.
+RecsysStatus recsys_load_genres(RecsysModel *model, const char *catalog_file) {
+  if (!model || !catalog_file || model->genres)
+    return RECSYS_ERR_ARGUMENT;
+  Catalog *genres = catalog_open(catalog_file);
+  if (!genres)
+    return RECSYS_ERR_IO;
+  if (!catalog_matches(genres, model->movie_ids, model->model->num_movies)) {
+    catalog_close(genres);
+    return RECSYS_ERR_FORMAT;
+  }
+  model->genres = genres;
+  score_catalog_set_genres(model->catalog, genres->genre_masks,
+                           genres->num_genres);
+  score_catalog_pack_genres(model->catalog);
+  return RECSYS_OK;
+}
+
+RecsysStatus recsys_genre_mask(const RecsysModel *model, const char *names,
+                               uint64_t *mask) {
+  if (!model || !names || !mask)
+    return RECSYS_ERR_ARGUMENT;
+  if (!model->genres || !catalog_genre_mask(model->genres, names, mask))
+    return RECSYS_ERR_GENRE;
+  return RECSYS_OK;
+}
+
+int recsys_num_movies(const RecsysModel *model) {
+  return model->model->num_movies;
+}
+
+int recsys_num_factors(const RecsysModel *model) {
+  return model->model->num_factors;
+}
+
+int recsys_movie_id(const RecsysModel *model, int index) {
+  if (index < 0 || index >= model->model->num_movies)
+    return -1;
+  return model->movie_ids[index];
+}
+
+// Translates original movie IDs into the model's, dropping unknown movies.
+static int map_ratings(const RecsysModel *model, const RecsysRating *ratings,
+                       int num_ratings, UserRating *mapped) {
+  int count = 0;
+  for (int i = 0; i < num_ratings; i++) {
+    int j = internal_id(model, ratings[i].movie_id);
+    if (j < 0)
+      continue;
+    mapped[count].movie_id = j;
+    mapped[count].rating = ratings[i].rating;
+    count++;
+  }
+  return count;
+}
+
+RecsysStatus recsys_fold_in(const RecsysModel *model,
+                            const RecsysRating *ratings, int num_ratings,
+                            float *profile, float *bias) {
+  if (!model || !profile || !bias || num_ratings < 0 ||
+      (num_ratings > 0 && !ratings))
+    return RECSYS_ERR_ARGUMENT;
+
+  UserRating *mapped =
+      (UserRating *)malloc((num_ratings + 1) * sizeof(UserRating));
+  int count = map_ratings(model, ratings, num_ratings, mapped);
+  RecsysStatus status = RECSYS_OK;
+  if (count == 0) {
+    for (int k = 0; k < model->model->num_factors; k++)
+      profile[k] = 0.0f;
+    *bias = 0.0f;
+    status = RECSYS_ERR_NO_RATINGS;
+  } else if (!fold_in_user(model->model, mapped, count, FOLDIN_REGULARIZATION,
+                           profile, bias)) {
+    status = RECSYS_ERR_SOLVE;
+  }
+  free(mapped);
+  return status;
+}
+
+int recsys_fold_in_batch(const RecsysModel *model, const int *offsets,
+                         const RecsysRating *ratings, int num_users,
+                         float *profiles, float *biases) {
+  if (!model || !offsets || !profiles || !biases || num_users <= 0)
+    return 0;
+
+  int total = offsets[num_users] - offsets[0];
+  UserRating *mapped = (UserRating *)malloc((total + 1) * sizeof(UserRating));
+  int *mapped_offsets = (int *)malloc((num_users + 1) * sizeof(int));
+  mapped_offsets[0] = 0;
+  for (int u = 0; u < num_users; u++) {
+    mapped_offsets[u + 1] =
+        mapped_offsets[u] +
+        map_ratings(model, ratings + offsets[u], offsets[u + 1] - offsets[u],
+                    mapped + mapped_offsets[u]);
+  }
+  int solved =
+      fold_in_users(model->model, mapped_offsets, mapped, num_users,
+                    FOLDIN_REGULARIZATION, profiles, biases);
+  free(mapped_offsets);
+  free(mapped);
+  return solved;
+}
+
+RecsysStatus recsys_score(const RecsysModel *model, const float *profile,
+                          float bias, const int *movie_ids, int num_movies,
+                          float *scores) {
+  if (!model || !profile || num_movies < 0 ||
+      (num_movies > 0 && (!movie_ids || !scores)))
+    return RECSYS_ERR_ARGUMENT;
+
+  const Model *m = model->model;
+  for (int i = 0; i < num_movies; i++) {
+    int j = internal_id(model, movie_ids[i]);
+    if (j < 0) {
+      scores[i] = 0.0f;
+      continue;
+    }
+    const float *row = m->movie_feature_data + (size_t)j * m->num_factors;
+    float score = m->global_mean + bias + m->movie_bias[j];
+    for (int k = 0; k < m->num_factors; k++)
+      score += profile[k] * row[k];
+    if (score > 5.0f)
+      score = 5.0f;
+    if (score < 0.5f)
+      score = 0.5f;
+    scores[i] = score;
+  }
+  return RECSYS_OK;
+}
+
+// The scoring kernel walks the exclusion list alongside the catalog, so it
+// must hold internal IDs in ascending order.
+static RecsysStatus top_k_internal(const RecsysModel *model,
+                                   const float *profile, float bias,
+                                   int *excluded, int num_excluded,
+                                   const RecsysFilter *filter, int k,
+                                   RecsysItem *items, int *num_items) {
+  qsort(excluded, num_excluded, sizeof(int), compare_ints);
+  if (k > model->model->num_movies)
+    k = model->model->num_movies;
+
+  Candidate *candidates = (Candidate *)malloc(k * sizeof(Candidate));
+  TopK topk;
+  topk_init(&topk, candidates, k);
+  ScoreRequest request = {profile,
+                          bias,
+                          excluded,
+                          num_excluded,
+                          &topk,
+                          filter ? filter->include_genres : 0,
+                          filter ? filter->exclude_genres : 0};
+  score_topk_batch(model->catalog, &request, 1);
+
+  for (int i = 0; i < topk.size; i++) {
+    items[i].movie_id = model->movie_ids[topk.items[i].id];
+    items[i].score = topk.items[i].score;
+    if (items[i].score > 5.0f)
+      items[i].score = 5.0f;
+    if (items[i].score < 0.5f)
+      items[i].score = 0.5f;
+  }
+  *num_items = topk.size;
+  free(candidates);
+  return RECSYS_OK;
+}
+
+static int unsupported_filter(const RecsysModel *model,
+                              const RecsysFilter *filter) {
+  return filter && (filter->include_genres || filter->exclude_genres) &&
+         !model->genres;
+}
+
+RecsysStatus recsys_top_k(const RecsysModel *model, const float *profile,
+                          float bias, const int *excluded_ids,
+                          int num_excluded, int k, RecsysItem *items,
+                          int *num_items) {
+  return recsys_top_k_filtered(model, profile, bias, excluded_ids,
+                               num_excluded, NULL, k, items, num_items);
+}
+
+RecsysStatus recsys_top_k_filtered(const RecsysModel *model,
+                                   const float *profile, float bias,
+                                   const int *excluded_ids, int num_excluded,
+                                   const RecsysFilter *filter, int k,
+                                   RecsysItem *items, int *num_items) {
+  if (!model || !profile || !items || !num_items || k <= 0 ||
+      num_excluded < 0 || (num_excluded > 0 && !excluded_ids))
+    return RECSYS_ERR_ARGUMENT;
+  if (unsupported_filter(model, filter))
+    return RECSYS_ERR_GENRE;
+
+  int *excluded = (int *)malloc((num_excluded + 1) * sizeof(int));
+  int count = 0;
+  for (int i = 0; i < num_excluded; i++) {
+    int j = internal_id(model, excluded_ids[i]);
+    if (j >= 0)
+      excluded[count++] = j;
+  }
+  RecsysStatus status = top_k_internal(model, profile, bias, excluded, count,
+                                       filter, k, items, num_items);
+  free(excluded);
+  return status;
+}
+
+RecsysStatus recsys_recommend(const RecsysModel *model,
+                              const RecsysRating *ratings, int num_ratings,
+                              int k, RecsysItem *items, int *num_items) {
+  return recsys_recommend_filtered(model, ratings, num_ratings, NULL, k, items,
+                                   num_items);
+}
+
+RecsysStatus recsys_recommend_filtered(const RecsysModel *model,
+                                       const RecsysRating *ratings,
+                                       int num_ratings,
+                                       const RecsysFilter *filter, int k,
+                                       RecsysItem *items, int *num_items) {
+  if (!model || !items || !num_items || k <= 0 || num_ratings < 0 ||
+      (num_ratings > 0 && !ratings))
+    return RECSYS_ERR_ARGUMENT;
+  if (unsupported_filter(model, filter))
+    return RECSYS_ERR_GENRE;
+
+  UserRating *mapped =
+      (UserRating *)malloc((num_ratings + 1) * sizeof(UserRating));
+  int count = map_ratings(model, ratings, num_ratings, mapped);
+  if (count == 0) {
+    free(mapped);
+    *num_items = 0;
+    return RECSYS_ERR_NO_RATINGS;
+  }
+
+  int num_factors = model->model->num_factors;
+  float *profile = (float *)malloc(num_factors * sizeof(float));
+  int *excluded = (int *)malloc(count * sizeof(int));
+  float bias;
+  RecsysStatus status = RECSYS_ERR_SOLVE;
+  *num_items = 0;
+  if (fold_in_user(model->model, mapped, count, FOLDIN_REGULARIZATION, profile,
+                   &bias)) {
+    for (int i = 0; i < count; i++)
+      excluded[i] = mapped[i].movie_id;
+    status = top_k_internal(model, profile, bias, excluded, count, filter, k,
+                            items, num_items);
+  }
+  free(excluded);
+  free(profile);
+  free(mapped);
+  return status;
+}
@@ -0,0 +1,122 @@
+#ifndef RECSYS_H
+#define RECSYS_H
+
+// Embeddable recommendation library. A RecsysModel is immutable once loaded,
+// so any number of threads may call the functions below on the same model
+// concurrently. Nothing is printed and there is no global state; every
+// function reports failure through its return value. Movie IDs are the
+// original IDs from movies.csv.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The library is built with hidden visibility; only these symbols export.
+#pragma GCC visibility push(default)
+
+typedef struct RecsysModel RecsysModel;
+
+typedef enum {
+  RECSYS_OK = 0,
+  RECSYS_ERR_IO = -1,
+  RECSYS_ERR_FORMAT = -2,
+  RECSYS_ERR_ARGUMENT = -3,
+  RECSYS_ERR_NO_RATINGS = -4,
+  RECSYS_ERR_SOLVE = -5,
+  RECSYS_ERR_GENRE = -6
+} RecsysStatus;
+
+typedef struct {
+  int movie_id;
+  float rating;
+} RecsysRating;
+
+typedef struct {
+  int movie_id;
+  float score;
+} RecsysItem;
+
+// Genre bitmasks from recsys_genre_mask. A movie passes if it has one of the
+// included genres, or include_genres is 0, and none of the excluded ones.
+typedef struct {
+  uint64_t include_genres;
+  uint64_t exclude_genres;
+} RecsysFilter;
+
+// Loads serving_model.bin and movie_mapping.bin as written by train_save.
+// Fails with RECSYS_ERR_IO if a file cannot be opened and RECSYS_ERR_FORMAT if
+// it is malformed, truncated or too large to allocate.
+RecsysStatus recsys_load(const char *serving_file, const char *mapping_file,
+                         RecsysModel **model);
+void recsys_free(RecsysModel *model);
+const char *recsys_status_string(RecsysStatus status);
+
+// Enables genre filters from catalog.bin as written by build_catalog. Call it
+// once after recsys_load, before the model is shared between threads.
+RecsysStatus recsys_load_genres(RecsysModel *model, const char *catalog_file);
+// Mask of a comma-separated list of genre names, ignoring case.
+RecsysStatus recsys_genre_mask(const RecsysModel *model, const char *names,
+                               uint64_t *mask);
+
+int recsys_num_movies(const RecsysModel *model);
+int recsys_num_factors(const RecsysModel *model);
+// Original ID of the index-th movie, for 0 <= index < recsys_num_movies().
+int recsys_movie_id(const RecsysModel *model, int index);
+
+// Solves a profile of recsys_num_factors() floats, plus a bias, for a user
+// who is not in the model. Ratings of unknown movies are ignored.
+RecsysStatus recsys_fold_in(const RecsysModel *model,
+                            const RecsysRating *ratings, int num_ratings,
+                            float *profile, float *bias);
+
+// Folds in num_users users at once, spreading them over OpenMP threads.
+// User u's ratings are ratings[offsets[u] .. offsets[u+1]). Profiles are
+// written to profiles + u * recsys_num_factors(). Users with no known movie
+// get a zero profile. Returns how many users were solved.
+int recsys_fold_in_batch(const RecsysModel *model, const int *offsets,
+                         const RecsysRating *ratings, int num_users,
+                         float *profiles, float *biases);
+
+// Predicted ratings, clamped to 0.5-5, for the given movies. Unknown movies
+// score 0.
+RecsysStatus recsys_score(const RecsysModel *model, const float *profile,
+                          float bias, const int *movie_ids, int num_movies,
+                          float *scores);
+
+// The k highest predicted ratings, best first, skipping the excluded movies.
+// Ranking uses the raw predictions; the reported scores are clamped to 0.5-5
+// like recsys_score's.
+// Writes up to k items and stores their count in *num_items.
+RecsysStatus recsys_top_k(const RecsysModel *model, const float *profile,
+                          float bias, const int *excluded_ids,
+                          int num_excluded, int k, RecsysItem *items,
+                          int *num_items);
+
+// Fold-in followed by top-K, excluding the movies the user rated.
+RecsysStatus recsys_recommend(const RecsysModel *model,
+                              const RecsysRating *ratings, int num_ratings,
+                              int k, RecsysItem *items, int *num_items);
+
+// recsys_top_k and recsys_recommend limited to the movies passing filter.
+// Fail with RECSYS_ERR_GENRE if the filter is not empty and no genres were
+// loaded.
+RecsysStatus recsys_top_k_filtered(const RecsysModel *model,
+                                   const float *profile, float bias,
+                                   const int *excluded_ids, int num_excluded,
+                                   const RecsysFilter *filter, int k,
+                                   RecsysItem *items, int *num_items);
+RecsysStatus recsys_recommend_filtered(const RecsysModel *model,
+                                       const RecsysRating *ratings,
+                                       int num_ratings,
+                                       const RecsysFilter *filter, int k,
+                                       RecsysItem *items, int *num_items);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
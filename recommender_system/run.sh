@@ -2,6 +2,7 @@
 
 MODEL_FILE="model.bin"
 MAPPING_FILE="movie_mapping.bin"
+SERVING_FILE="serving_model.bin"
 MOVIES_FILE="../data/movies.csv"
 
 echo "Current directory: $(pwd)"
@@ -16,6 +17,12 @@ if [ ! -f "$MODEL_FILE" ]; then
     exit 1
 fi
 
+if [ ! -f "$SERVING_FILE" ]; then
+    echo "Error: $SERVING_FILE not found"
+    echo "Please run './train.sh' again to write the serving model"
+    exit 1
+fi
+
 if [ ! -f "$MAPPING_FILE" ]; then
     echo "Error: $MAPPING_FILE not found"
     echo "Please run './train.sh' first to train the model"
@@ -25,6 +32,7 @@ fi
 echo "Found model files:"
 echo "  - model.bin ($(ls -lh model.bin | awk '{print $5}'))"
 echo "  - movie_mapping.bin ($(ls -lh movie_mapping.bin | awk '{print $5}'))"
+echo "  - serving_model.bin ($(ls -lh serving_model.bin | awk '{print $5}'))"
 echo ""
 
 if [ ! -f "$MOVIES_FILE" ]; then
@@ -43,7 +51,7 @@ if [ ! -f "data/movies.csv" ]; then
     cp "$MOVIES_FILE" data/movies.csv
 fi
 
-if [ ! -f "recommend" ] || [ "recommend.c" -nt "recommend" ] || [ "model.c" -nt "recommend" ]; then
+if [ ! -f "recommend" ] || [ "recommend.c" -nt "recommend" ] || [ "model.c" -nt "recommend" ] || [ "mips_index.c" -nt "recommend" ]; then
     echo "Building recommend"
     rm -f *.o recommend
     make recommend
@@ -57,9 +65,14 @@ if [ ! -f "recommend" ]; then
     exit 1
 fi
 
+if [ ! -f "catalog.bin" ] || [ "data/movies.csv" -nt "catalog.bin" ] || [ "$MAPPING_FILE" -nt "catalog.bin" ]; then
+    echo "Compiling movie catalog"
+    make build_catalog && ./build_catalog data/movies.csv || exit 1
+fi
+
 echo "Build successful"
 echo ""
 echo "  Movie Recommender System"
 echo ""
 
-./recommend
\ No newline at end of file
+./recommend "$@"
\ No newline at end of file
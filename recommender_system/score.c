@@ -0,0 +1,267 @@
+#include "score.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Packs `count` movies, taken from `ids` or contiguous when ids is NULL,
+// into factor-major panels of SCORE_NR.
+static void pack_panels(const float *movie_features, const int *ids,
+                        int count, int num_factors, float *packed) {
+  size_t panel_size = (size_t)num_factors * SCORE_NR;
+  for (int i = 0; i < count; i++) {
+    float *panel = packed + (i / SCORE_NR) * panel_size;
+    int j = ids ? ids[i] : i;
+    const float *row = movie_features + (size_t)j * num_factors;
+    for (int k = 0; k < num_factors; k++) {
+      panel[k * SCORE_NR + i % SCORE_NR] = row[k];
+    }
+  }
+}
+
+ScoreCatalog *score_catalog_create(const float *movie_features,
+                                   const float *movie_bias, float global_mean,
+                                   int num_movies, int num_factors) {
+  ScoreCatalog *catalog = (ScoreCatalog *)calloc(1, sizeof(ScoreCatalog));
+  catalog->movie_features = movie_features;
+  catalog->movie_bias = movie_bias;
+  catalog->global_mean = global_mean;
+  catalog->num_movies = num_movies;
+  catalog->num_factors = num_factors;
+  catalog->num_panels = (num_movies + SCORE_NR - 1) / SCORE_NR;
+
+  size_t panel_size = (size_t)num_factors * SCORE_NR;
+  catalog->packed = (float *)calloc(catalog->num_panels * panel_size,
+                                    sizeof(float));
+  pack_panels(movie_features, NULL, num_movies, num_factors, catalog->packed);
+  return catalog;
+}
+
+// The masks alone are enough to filter: include filters are then applied in
+// the epilogue of a full scan.
+void score_catalog_set_genres(ScoreCatalog *catalog,
+                              const uint64_t *genre_masks, int num_genres) {
+  catalog->genre_masks = genre_masks;
+  catalog->num_genres = num_genres;
+}
+
+// Genre g's movies are genre_movies[genre_offsets[g] .. genre_offsets[g+1]),
+// in ascending order. Each genre's panels start on a panel boundary: genre g
+// begins at panel (genre_offsets[g] / SCORE_NR) + g of genre_packed. This
+// costs one more copy of the factors per genre a movie has, so one-shot
+// callers only pack when a request includes genres.
+void score_catalog_pack_genres(ScoreCatalog *catalog) {
+  const uint64_t *genre_masks = catalog->genre_masks;
+  int num_genres = catalog->num_genres;
+  catalog->genre_offsets = (int *)calloc(num_genres + 1, sizeof(int));
+  for (int j = 0; j < catalog->num_movies; j++) {
+    for (int g = 0; g < num_genres; g++) {
+      if (genre_masks[j] & (1ULL << g))
+        catalog->genre_offsets[g + 1]++;
+    }
+  }
+  for (int g = 0; g < num_genres; g++)
+    catalog->genre_offsets[g + 1] += catalog->genre_offsets[g];
+
+  int total = catalog->genre_offsets[num_genres];
+  catalog->genre_movies = (int *)malloc((total + 1) * sizeof(int));
+  int *fill = (int *)malloc((num_genres + 1) * sizeof(int));
+  memcpy(fill, catalog->genre_offsets, (num_genres + 1) * sizeof(int));
+  for (int j = 0; j < catalog->num_movies; j++) {
+    for (int g = 0; g < num_genres; g++) {
+      if (genre_masks[j] & (1ULL << g))
+        catalog->genre_movies[fill[g]++] = j;
+    }
+  }
+  free(fill);
+
+  size_t panel_size = (size_t)catalog->num_factors * SCORE_NR;
+  size_t num_panels = total / SCORE_NR + num_genres;
+  catalog->genre_packed = (float *)calloc(num_panels * panel_size,
+                                          sizeof(float));
+  for (int g = 0; g < num_genres; g++) {
+    int start = catalog->genre_offsets[g];
+    float *packed =
+        catalog->genre_packed + (size_t)(start / SCORE_NR + g) * panel_size;
+    pack_panels(catalog->movie_features, catalog->genre_movies + start,
+                catalog->genre_offsets[g + 1] - start, catalog->num_factors,
+                packed);
+  }
+}
+
+void score_catalog_free(ScoreCatalog *catalog) {
+  if (catalog) {
+    free(catalog->packed);
+    free(catalog->genre_offsets);
+    free(catalog->genre_movies);
+    free(catalog->genre_packed);
+    free(catalog);
+  }
+}
+
+// MR x NR register block: each factor step loads MR user values and one NR
+// row of the packed panel, and performs MR x NR multiply-adds with no
+// horizontal reductions.
+static void micro_kernel(const float *const *profiles, int num_factors,
+                         const float *panel, float acc[SCORE_MR][SCORE_NR]) {
+  for (int u = 0; u < SCORE_MR; u++) {
+    for (int j = 0; j < SCORE_NR; j++) {
+      acc[u][j] = 0.0f;
+    }
+  }
+  for (int k = 0; k < num_factors; k++) {
+    const float *b = panel + k * SCORE_NR;
+    for (int u = 0; u < SCORE_MR; u++) {
+      float a = profiles[u][k];
+#pragma omp simd
+      for (int j = 0; j < SCORE_NR; j++) {
+        acc[u][j] += a * b[j];
+      }
+    }
+  }
+}
+
+// A set of packed panels to scan: `count` movies, numbered by `ids` (or
+// contiguous from 0 when ids is NULL). Movies carrying any of the `seen`
+// genres were already offered to include-filtered requests by an earlier
+// genre pass and are skipped for them.
+typedef struct {
+  const float *packed;
+  const int *ids;
+  int count;
+  uint64_t seen;
+} PanelSet;
+
+// Epilogue: add the biases and feed the user's top-K heap, skipping movies in
+// the user's sorted exclusion list with a cursor that only moves forward, and
+// movies the user's genre filter rejects.
+static void push_scores(const ScoreCatalog *catalog, const PanelSet *set,
+                        ScoreRequest *request, int *cursor, int start,
+                        const float *acc) {
+  int end = start + SCORE_NR < set->count ? start + SCORE_NR : set->count;
+  float base = catalog->global_mean + request->bias;
+  uint64_t include = request->include_genres;
+  for (int i = start; i < end; i++) {
+    int j = set->ids ? set->ids[i] : i;
+    while (*cursor < request->num_excluded && request->excluded[*cursor] < j)
+      (*cursor)++;
+    if (*cursor < request->num_excluded && request->excluded[*cursor] == j)
+      continue;
+    if (catalog->genre_masks) {
+      uint64_t mask = catalog->genre_masks[j];
+      if ((include && !(mask & include)) || (mask & include & set->seen) ||
+          (mask & request->exclude_genres))
+        continue;
+    }
+    float score = base + catalog->movie_bias[j] + acc[i - start];
+    topk_push(request->topk, score, j);
+  }
+}
+
+// The user panel's profiles stay in L2 while each packed movie panel is
+// reused from L1 by every MR block of users.
+static void scan_panels(const ScoreCatalog *catalog, const PanelSet *set,
+                        ScoreRequest **requests, int num_requests) {
+  size_t panel_size = (size_t)catalog->num_factors * SCORE_NR;
+  int cursors[SCORE_USER_PANEL];
+  memset(cursors, 0, sizeof(cursors));
+
+  int num_panels = (set->count + SCORE_NR - 1) / SCORE_NR;
+  for (int p = 0; p < num_panels; p++) {
+    const float *panel = set->packed + p * panel_size;
+    for (int u = 0; u < num_requests; u += SCORE_MR) {
+      const float *profiles[SCORE_MR];
+      int block = num_requests - u < SCORE_MR ? num_requests - u : SCORE_MR;
+      for (int r = 0; r < SCORE_MR; r++) {
+        profiles[r] = requests[u + (r < block ? r : 0)]->profile;
+      }
+
+      float acc[SCORE_MR][SCORE_NR];
+      micro_kernel(profiles, catalog->num_factors, panel, acc);
+      for (int r = 0; r < block; r++) {
+        push_scores(catalog, set, requests[u + r], &cursors[u + r],
+                    p * SCORE_NR, acc[r]);
+      }
+    }
+  }
+}
+
+// Requests without an include filter scan the full catalog. With genre panels
+// packed, requests with one scan only the panels of their included genres, so
+// their cost is proportional to the number of movies they can return. Genre
+// filters are ignored if the catalog has no genre masks.
+void score_topk_batch(const ScoreCatalog *catalog, ScoreRequest *requests,
+                      int num_requests) {
+  size_t panel_size = (size_t)catalog->num_factors * SCORE_NR;
+  ScoreRequest *group[SCORE_USER_PANEL];
+
+  for (int i = 0; i < num_requests; i++) {
+    requests[i].topk->size = 0;
+  }
+
+  for (int u0 = 0; u0 < num_requests; u0 += SCORE_USER_PANEL) {
+    int u_end = u0 + SCORE_USER_PANEL < num_requests ? u0 + SCORE_USER_PANEL
+                                                     : num_requests;
+    int num_group = 0;
+    for (int u = u0; u < u_end; u++) {
+      if (!catalog->genre_packed || !requests[u].include_genres)
+        group[num_group++] = &requests[u];
+    }
+    if (num_group > 0) {
+      PanelSet all = {catalog->packed, NULL, catalog->num_movies, 0};
+      scan_panels(catalog, &all, group, num_group);
+    }
+    if (!catalog->genre_packed)
+      continue;
+
+    for (int g = 0; g < catalog->num_genres; g++) {
+      uint64_t bit = 1ULL << g;
+      num_group = 0;
+      for (int u = u0; u < u_end; u++) {
+        if (requests[u].include_genres & bit)
+          group[num_group++] = &requests[u];
+      }
+      if (num_group == 0)
+        continue;
+      int start = catalog->genre_offsets[g];
+      PanelSet genre = {catalog->genre_packed +
+                            (size_t)(start / SCORE_NR + g) * panel_size,
+                        catalog->genre_movies + start,
+                        catalog->genre_offsets[g + 1] - start, bit - 1};
+      scan_panels(catalog, &genre, group, num_group);
+    }
+  }
+
+  for (int i = 0; i < num_requests; i++) {
+    topk_sort(requests[i].topk);
+  }
+}
+
+void score_all(const ScoreCatalog *catalog, const float *profile, float bias,
+               int clamp, float *scores) {
+  size_t panel_size = (size_t)catalog->num_factors * SCORE_NR;
+  float base = catalog->global_mean + bias;
+
+  for (int p = 0; p < catalog->num_panels; p++) {
+    const float *panel = catalog->packed + p * panel_size;
+    float acc[SCORE_NR] = {0.0f};
+    for (int k = 0; k < catalog->num_factors; k++) {
+#pragma omp simd
+      for (int j = 0; j < SCORE_NR; j++) {
+        acc[j] += profile[k] * panel[k * SCORE_NR + j];
+      }
+    }
+    int movie_start = p * SCORE_NR;
+    int movie_end = movie_start + SCORE_NR < catalog->num_movies
+                        ? movie_start + SCORE_NR
+                        : catalog->num_movies;
+    for (int j = movie_start; j < movie_end; j++) {
+      float score = base + catalog->movie_bias[j] + acc[j - movie_start];
+      if (clamp) {
+        if (score > 5.0f)
+          score = 5.0f;
+        if (score < 0.5f)
+          score = 0.5f;
+      }
+      scores[j] = score;
+    }
+  }
+}
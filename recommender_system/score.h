@@ -0,0 +1,55 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include "topk.h"
+#include <stdint.h>
+
+#define SCORE_MR 4
+#define SCORE_NR 16
+#define SCORE_USER_PANEL 64
+
+// Movie factors repacked for the scoring kernel: movies are grouped into
+// panels of SCORE_NR, and each panel is stored factor-major so the kernel
+// streams one contiguous num_factors x SCORE_NR block per panel.
+//
+// With genre masks attached, requests can filter by genre. Once the genre
+// panels are packed as well, the movies of each genre have their own panels,
+// so a request that includes genres scans only those.
+typedef struct {
+  float *packed;
+  const float *movie_features;
+  const float *movie_bias;
+  float global_mean;
+  int num_movies;
+  int num_factors;
+  int num_panels;
+  const uint64_t *genre_masks;
+  int num_genres;
+  int *genre_offsets;
+  int *genre_movies;
+  float *genre_packed;
+} ScoreCatalog;
+
+typedef struct {
+  const float *profile;
+  float bias;
+  const int *excluded;
+  int num_excluded;
+  TopK *topk;
+  uint64_t include_genres;
+  uint64_t exclude_genres;
+} ScoreRequest;
+
+ScoreCatalog *score_catalog_create(const float *movie_features,
+                                   const float *movie_bias, float global_mean,
+                                   int num_movies, int num_factors);
+void score_catalog_set_genres(ScoreCatalog *catalog,
+                              const uint64_t *genre_masks, int num_genres);
+void score_catalog_pack_genres(ScoreCatalog *catalog);
+void score_catalog_free(ScoreCatalog *catalog);
+void score_topk_batch(const ScoreCatalog *catalog, ScoreRequest *requests,
+                      int num_requests);
+void score_all(const ScoreCatalog *catalog, const float *profile, float bias,
+               int clamp, float *scores);
+
+#endif
@@ -0,0 +1,821 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "catalog.h"
+#include "config.h"
+#include "foldin.h"
+#include "mips_index.h"
+#include "model.h"
+#include "movies.h"
+#include "score.h"
+#include "topk.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <omp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  long long inode;
+  long long size;
+  long long mtime_ns;
+} FileStamp;
+
+typedef struct {
+  FileStamp model;
+  FileStamp mapping;
+  FileStamp index;
+  FileStamp catalog;
+} ModelStamps;
+
+// Everything a request reads. A ServingModel is never written after it is
+// published, so workers share it without locks; a reload builds a new one.
+typedef struct {
+  Model *model;
+  Precision precision;
+  int *original_ids;
+  int *remap;
+  int max_id;
+  ScoreCatalog *catalog;
+  MipsIndex *index;
+  Catalog *genres;
+  ModelStamps stamps;
+  int generation;
+} ServingModel;
+
+// A worker publishes the ServingModel it is using here for the duration of
+// one request. The reloader frees a replaced model only once no slot holds
+// it. Slots are padded to separate cache lines.
+typedef struct {
+  ServingModel *serving;
+  char pad[64 - sizeof(ServingModel *)];
+} HazardSlot;
+
+#define MAX_EVENTS 64
+
+// A client connection and the bytes it has sent that are not yet answered.
+// It is registered with EPOLLONESHOT, so at most one worker holds it at a
+// time; the worker re-arms it once the buffer has no complete request left.
+typedef struct Connection {
+  int fd;
+  char *buf;
+  size_t len;
+  size_t cap;
+  struct Connection *prev;
+  struct Connection *next;
+} Connection;
+
+// Connections with a request ready to serve. NULL tells a worker to exit.
+typedef struct {
+  Connection *items[SERVER_QUEUE_SIZE];
+  int head;
+  int count;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} ConnQueue;
+
+typedef struct {
+  ServingModel *current;
+  HazardSlot *hazards;
+  int num_threads;
+  const char *index_file;
+  ConnQueue queue;
+  int epoll_fd;
+  Connection *connections;
+  pthread_mutex_t connections_lock;
+  int nprobe;
+  int rerank;
+} Server;
+
+typedef struct {
+  Server *server;
+  int id;
+} Worker;
+
+// Per-worker buffers, grown on demand and reused across requests.
+typedef struct {
+  UserRating *ratings;
+  int *excluded;
+  int ratings_cap;
+  Candidate *candidates;
+  int candidates_cap;
+  float *profile;
+  int profile_cap;
+  char *out;
+  size_t out_cap;
+} Scratch;
+
+static volatile sig_atomic_t stop_requested = 0;
+static int wake_fd = -1;
+
+// Only the main thread takes SIGINT/SIGTERM. The byte written to the wake
+// pipe ends its epoll_wait even if the signal lands just before the call.
+static void handle_signal(int sig) {
+  (void)sig;
+  int saved_errno = errno;
+  stop_requested = 1;
+  ssize_t n = write(wake_fd, "", 1);
+  (void)n;
+  errno = saved_errno;
+}
+
+static FileStamp file_stamp(const char *filename) {
+  FileStamp stamp = {0, 0, 0};
+  struct stat st;
+  if (filename && stat(filename, &st) == 0) {
+    stamp.inode = st.st_ino;
+    stamp.size = st.st_size;
+    stamp.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  }
+  return stamp;
+}
+
+static ModelStamps model_stamps(const char *index_file) {
+  ModelStamps stamps;
+  stamps.model = file_stamp(SERVING_FILE);
+  stamps.mapping = file_stamp(MAPPING_FILE);
+  stamps.index = file_stamp(index_file);
+  stamps.catalog = file_stamp(CATALOG_FILE);
+  return stamps;
+}
+
+static int same_stamps(const ModelStamps *a, const ModelStamps *b) {
+  return memcmp(a, b, sizeof(ModelStamps)) == 0;
+}
+
+static void serving_model_free(ServingModel *serving);
+
+// The index is only used if it was written after the model, so a retrained
+// model never pairs with an index built from the previous factors. Genre
+// filters need catalog.bin; filtered requests are always scored exactly, so
+// with a catalog the packed movie panels are kept next to the index.
+static ServingModel *serving_model_load(const char *index_file,
+                                        const ModelStamps *stamps) {
+  Precision precision;
+  Model *model = load_serving_model(SERVING_FILE, &precision, NULL);
+  if (!model)
+    return NULL;
+
+  ServingModel *serving = (ServingModel *)calloc(1, sizeof(ServingModel));
+  serving->model = model;
+  serving->precision = precision;
+  serving->stamps = *stamps;
+  int num_movies;
+  serving->original_ids = load_movie_mapping(MAPPING_FILE, &num_movies);
+  if (!serving->original_ids || num_movies != model->num_movies) {
+    fprintf(stderr, "Error: %s does not match %s\n", MAPPING_FILE,
+            SERVING_FILE);
+    serving_model_free(serving);
+    return NULL;
+  }
+  for (int i = 0; i < num_movies; i++) {
+    if (serving->original_ids[i] > serving->max_id)
+      serving->max_id = serving->original_ids[i];
+  }
+  serving->remap = (int *)malloc((serving->max_id + 1) * sizeof(int));
+  for (int j = 0; j <= serving->max_id; j++)
+    serving->remap[j] = -1;
+  for (int i = 0; i < num_movies; i++)
+    serving->remap[serving->original_ids[i]] = i;
+
+  if (index_file && stamps->index.mtime_ns >= stamps->model.mtime_ns)
+    serving->index = mips_index_load(index_file);
+  if (serving->index && (serving->index->num_movies != model->num_movies ||
+                         serving->index->num_factors != model->num_factors)) {
+    fprintf(stderr, "%s does not match %s; using exact scoring\n", index_file,
+            SERVING_FILE);
+    mips_index_free(serving->index);
+    serving->index = NULL;
+  }
+  serving->genres = catalog_open(CATALOG_FILE);
+  if (serving->genres &&
+      !catalog_matches(serving->genres, serving->original_ids, num_movies)) {
+    fprintf(stderr, "%s does not match %s; genre filters disabled\n",
+            CATALOG_FILE, MAPPING_FILE);
+    catalog_close(serving->genres);
+    serving->genres = NULL;
+  }
+  if (!serving->index || serving->genres) {
+    serving->catalog = score_catalog_create(
+        model->movie_feature_data, model->movie_bias, model->global_mean,
+        model->num_movies, model->num_factors);
+  }
+  if (serving->genres) {
+    score_catalog_set_genres(serving->catalog, serving->genres->genre_masks,
+                             serving->genres->num_genres);
+    score_catalog_pack_genres(serving->catalog);
+  }
+  return serving;
+}
+
+static void serving_model_free(ServingModel *serving) {
+  if (serving) {
+    score_catalog_free(serving->catalog);
+    mips_index_free(serving->index);
+    catalog_close(serving->genres);
+    free(serving->remap);
+    free(serving->original_ids);
+    if (serving->model)
+      free_model(serving->model);
+    free(serving);
+  }
+}
+
+static ServingModel *acquire_serving(Server *server, HazardSlot *slot) {
+  ServingModel *serving;
+  do {
+    serving = __atomic_load_n(&server->current, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->serving, serving, __ATOMIC_SEQ_CST);
+  } while (serving != __atomic_load_n(&server->current, __ATOMIC_SEQ_CST));
+  return serving;
+}
+
+static void release_serving(HazardSlot *slot) {
+  __atomic_store_n(&slot->serving, NULL, __ATOMIC_RELEASE);
+}
+
+static void sleep_ms(int ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+// Polls the model files and reloads once a changed set has been stable for
+// one interval. The new model is built off the request path, swapped in with
+// one atomic store, and the old one is freed after in-flight requests drain.
+static void *reload_main(void *arg) {
+  Server *server = (Server *)arg;
+  ModelStamps pending = server->current->stamps;
+  ModelStamps failed;
+  memset(&failed, 0, sizeof(failed));
+
+  while (!stop_requested) {
+    sleep_ms(SERVER_RELOAD_INTERVAL_MS);
+    ModelStamps stamps = model_stamps(server->index_file);
+    ServingModel *old = server->current;
+    if (same_stamps(&stamps, &old->stamps) || same_stamps(&stamps, &failed) ||
+        stamps.model.size == 0)
+      continue;
+    if (!same_stamps(&stamps, &pending)) {
+      pending = stamps;
+      continue;
+    }
+
+    double start = omp_get_wtime();
+    ServingModel *fresh = serving_model_load(server->index_file, &stamps);
+    if (!fresh) {
+      fprintf(stderr, "Reload failed; still serving generation %d\n",
+              old->generation);
+      failed = stamps;
+      continue;
+    }
+    fresh->generation = old->generation + 1;
+    __atomic_store_n(&server->current, fresh, __ATOMIC_SEQ_CST);
+
+    for (int t = 0; t < server->num_threads; t++) {
+      while (__atomic_load_n(&server->hazards[t].serving, __ATOMIC_SEQ_CST) ==
+             old)
+        sleep_ms(1);
+    }
+    serving_model_free(old);
+    printf("Reloaded model generation %d: %d movies, %s (%s scoring, "
+           "%.2f s)\n",
+           fresh->generation, fresh->model->num_movies,
+           precision_name(fresh->precision),
+           fresh->index ? "indexed" : "exact", omp_get_wtime() - start);
+    fflush(stdout);
+  }
+  return NULL;
+}
+
+static void queue_push(ConnQueue *queue, Connection *conn) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == SERVER_QUEUE_SIZE)
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+  queue->items[(queue->head + queue->count) % SERVER_QUEUE_SIZE] = conn;
+  queue->count++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Workers requeue without blocking, so they can never all wait on a full
+// queue that only they drain.
+static int queue_try_push(ConnQueue *queue, Connection *conn) {
+  pthread_mutex_lock(&queue->lock);
+  int pushed = queue->count < SERVER_QUEUE_SIZE;
+  if (pushed) {
+    queue->items[(queue->head + queue->count) % SERVER_QUEUE_SIZE] = conn;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return pushed;
+}
+
+static Connection *queue_pop(ConnQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0)
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  Connection *conn = queue->items[queue->head];
+  queue->head = (queue->head + 1) % SERVER_QUEUE_SIZE;
+  queue->count--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return conn;
+}
+
+static int watch_connection(Server *server, Connection *conn, int op) {
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = conn;
+  return epoll_ctl(server->epoll_fd, op, conn->fd, &event) == 0;
+}
+
+static void add_connection(Server *server, int fd) {
+  Connection *conn = (Connection *)calloc(1, sizeof(Connection));
+  conn->fd = fd;
+  pthread_mutex_lock(&server->connections_lock);
+  conn->next = server->connections;
+  if (conn->next)
+    conn->next->prev = conn;
+  server->connections = conn;
+  pthread_mutex_unlock(&server->connections_lock);
+  if (!watch_connection(server, conn, EPOLL_CTL_ADD))
+    fprintf(stderr, "Error watching connection: %s\n", strerror(errno));
+}
+
+static void close_connection(Server *server, Connection *conn) {
+  pthread_mutex_lock(&server->connections_lock);
+  if (conn->prev)
+    conn->prev->next = conn->next;
+  else
+    server->connections = conn->next;
+  if (conn->next)
+    conn->next->prev = conn->prev;
+  pthread_mutex_unlock(&server->connections_lock);
+  close(conn->fd);
+  free(conn->buf);
+  free(conn);
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 1;
+}
+
+static float clamp_rating(float prediction) {
+  if (prediction > 5.0f)
+    prediction = 5.0f;
+  if (prediction < 0.5f)
+    prediction = 0.5f;
+  return prediction;
+}
+
+static void scratch_reserve_output(Scratch *scratch, size_t len) {
+  if (len > scratch->out_cap) {
+    scratch->out_cap = len;
+    scratch->out = (char *)realloc(scratch->out, len);
+  }
+}
+
+// Reads the genre=A,B and exclude=C,D options that may follow k, OR-ing
+// them into the masks. Returns an error reason or NULL.
+static const char *parse_genre_options(const ServingModel *serving,
+                                       char **cursor, uint64_t *include,
+                                       uint64_t *exclude) {
+  while (1) {
+    char *option = *cursor + strspn(*cursor, " ");
+    uint64_t *mask = NULL;
+    if (strncmp(option, "genre=", 6) == 0)
+      mask = include;
+    else if (strncmp(option, "exclude=", 8) == 0)
+      mask = exclude;
+    if (!mask)
+      return NULL;
+    if (!serving->genres)
+      return "genre filters need " CATALOG_FILE;
+
+    char *list = strchr(option, '=') + 1;
+    size_t len = strcspn(list, " \r\n");
+    char saved = list[len];
+    list[len] = '\0';
+    uint64_t bits;
+    int known = catalog_genre_mask(serving->genres, list, &bits);
+    list[len] = saved;
+    if (!known)
+      return "unknown genre";
+    *mask |= bits;
+    *cursor = list + len;
+  }
+}
+
+// Request:  REC <k> [genre=A,B] [exclude=C,D] <movieId>:<rating> ...
+// Response: OK <n> <movieId> <predicted rating> ...  or  ERR <reason>
+static size_t handle_request(const Server *server,
+                             const ServingModel *serving, char *line,
+                             Scratch *scratch) {
+  const Model *model = serving->model;
+
+  char *cursor = line;
+  if (strncmp(cursor, "PING", 4) == 0) {
+    scratch_reserve_output(scratch, 8);
+    return sprintf(scratch->out, "PONG\n");
+  }
+  scratch_reserve_output(scratch, 64);
+  if (strncmp(cursor, "REC ", 4) != 0)
+    return sprintf(scratch->out, "ERR unknown command\n");
+  cursor += 4;
+
+  char *end;
+  long k = strtol(cursor, &end, 10);
+  if (end == cursor || k <= 0)
+    return sprintf(scratch->out, "ERR bad k\n");
+  if (k > model->num_movies)
+    k = model->num_movies;
+  cursor = end;
+
+  uint64_t include_genres = 0, exclude_genres = 0;
+  const char *error =
+      parse_genre_options(serving, &cursor, &include_genres, &exclude_genres);
+  if (error)
+    return sprintf(scratch->out, "ERR %s\n", error);
+
+  int num_ratings = 0;
+  while (1) {
+    long id = strtol(cursor, &end, 10);
+    if (end == cursor)
+      break;
+    cursor = end;
+    if (*cursor != ':')
+      return sprintf(scratch->out, "ERR expected movieId:rating\n");
+    cursor++;
+    float rating = strtof(cursor, &end);
+    if (end == cursor)
+      return sprintf(scratch->out, "ERR bad rating\n");
+    cursor = end;
+    if (id < 0 || id > serving->max_id || serving->remap[id] < 0)
+      continue;
+
+    if (num_ratings == scratch->ratings_cap) {
+      scratch->ratings_cap = scratch->ratings_cap ? 2 * scratch->ratings_cap
+                                                  : 64;
+      scratch->ratings = (UserRating *)realloc(
+          scratch->ratings, scratch->ratings_cap * sizeof(UserRating));
+      scratch->excluded = (int *)realloc(
+          scratch->excluded, scratch->ratings_cap * sizeof(int));
+    }
+    if (rating < 0.5f)
+      rating = 0.5f;
+    if (rating > 5.0f)
+      rating = 5.0f;
+    scratch->ratings[num_ratings].movie_id = serving->remap[id];
+    scratch->ratings[num_ratings].rating = rating;
+    scratch->excluded[num_ratings] = serving->remap[id];
+    num_ratings++;
+  }
+  if (num_ratings == 0)
+    return sprintf(scratch->out, "ERR no known movies rated\n");
+
+  if (model->num_factors > scratch->profile_cap) {
+    scratch->profile_cap = model->num_factors;
+    scratch->profile = (float *)realloc(scratch->profile,
+                                        scratch->profile_cap * sizeof(float));
+  }
+  float bias;
+  fold_in_user(model, scratch->ratings, num_ratings, FOLDIN_REGULARIZATION,
+               scratch->profile, &bias);
+  qsort(scratch->excluded, num_ratings, sizeof(int), compare_ints);
+
+  if (k > scratch->candidates_cap) {
+    scratch->candidates_cap = k;
+    scratch->candidates = (Candidate *)realloc(scratch->candidates,
+                                               k * sizeof(Candidate));
+  }
+  TopK topk;
+  topk_init(&topk, scratch->candidates, k);
+  // The index has no genre information, so filtered requests are scored
+  // exactly with the filter pushed into the scan.
+  if (serving->index && !include_genres && !exclude_genres) {
+    mips_index_search(serving->index, model, scratch->profile, bias,
+                      scratch->excluded, num_ratings, server->nprobe,
+                      server->rerank, &topk);
+  } else {
+    ScoreRequest request = {scratch->profile, bias, scratch->excluded,
+                            num_ratings, &topk, include_genres,
+                            exclude_genres};
+    score_topk_batch(serving->catalog, &request, 1);
+  }
+
+  scratch_reserve_output(scratch, 32 + (size_t)topk.size * 32);
+  size_t len = sprintf(scratch->out, "OK %d", topk.size);
+  for (int i = 0; i < topk.size; i++) {
+    len += sprintf(scratch->out + len, " %d %.4f",
+                   serving->original_ids[topk.items[i].id],
+                   clamp_rating(topk.items[i].score));
+  }
+  scratch->out[len++] = '\n';
+  return len;
+}
+
+static int has_request(const Connection *conn) {
+  return memchr(conn->buf, '\n', conn->len) != NULL;
+}
+
+// Answers one request line, reading whatever the client has sent if no
+// complete line is buffered yet. Reads never block, so a worker is only
+// busy while there is a request to answer. Returns 0 once the connection
+// should be closed.
+static int serve_request(Server *server, HazardSlot *slot, Connection *conn,
+                         Scratch *scratch) {
+  char *newline = memchr(conn->buf, '\n', conn->len);
+  int eof = 0;
+  if (!newline) {
+    if (conn->len == conn->cap) {
+      conn->cap = conn->cap ? 2 * conn->cap : MAX_LINE_LENGTH;
+      conn->buf = (char *)realloc(conn->buf, conn->cap);
+    }
+    ssize_t n = recv(conn->fd, conn->buf + conn->len, conn->cap - conn->len,
+                     MSG_DONTWAIT);
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    if (n == 0) {
+      // A last line without a newline is still answered, as getline would.
+      if (conn->len == 0)
+        return 0;
+      eof = 1;
+      conn->buf[conn->len] = '\n';
+      newline = conn->buf + conn->len++;
+    } else {
+      newline = memchr(conn->buf + conn->len, '\n', n);
+      conn->len += n;
+      if (!newline)
+        return 1;
+    }
+  }
+
+  *newline = '\0';
+  ServingModel *serving = acquire_serving(server, slot);
+  size_t len = handle_request(server, serving, conn->buf, scratch);
+  release_serving(slot);
+  size_t used = newline + 1 - conn->buf;
+  memmove(conn->buf, newline + 1, conn->len - used);
+  conn->len -= used;
+  return write_all(conn->fd, scratch->out, len) && !eof;
+}
+
+// The unit of work is one request, not one connection: after each reply the
+// connection goes back to the queue if it has another request buffered, or
+// back to epoll otherwise, so idle clients never hold a worker.
+static void *worker_main(void *arg) {
+  Worker *worker = (Worker *)arg;
+  Server *server = worker->server;
+  HazardSlot *slot = &server->hazards[worker->id];
+  Scratch scratch;
+  memset(&scratch, 0, sizeof(scratch));
+  Connection *conn;
+  while ((conn = queue_pop(&server->queue)) != NULL) {
+    while (1) {
+      if (!serve_request(server, slot, conn, &scratch)) {
+        close_connection(server, conn);
+        break;
+      }
+      if (!has_request(conn)) {
+        if (!watch_connection(server, conn, EPOLL_CTL_MOD))
+          close_connection(server, conn);
+        break;
+      }
+      if (queue_try_push(&server->queue, conn))
+        break;
+    }
+  }
+  free(scratch.ratings);
+  free(scratch.excluded);
+  free(scratch.candidates);
+  free(scratch.profile);
+  free(scratch.out);
+  return NULL;
+}
+
+static int open_listener(const char *socket_path, int port) {
+  int fd;
+  if (port > 0) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      fprintf(stderr, "Error binding 127.0.0.1:%d: %s\n", port,
+              strerror(errno));
+      close(fd);
+      return -1;
+    }
+  } else {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      fprintf(stderr, "Error binding %s: %s\n", socket_path, strerror(errno));
+      close(fd);
+      return -1;
+    }
+  }
+  if (listen(fd, SOMAXCONN) != 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+    fprintf(stderr, "Error listening: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void accept_connections(Server *server, int listen_fd, int port) {
+  while (1) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        fprintf(stderr, "Error accepting: %s\n", strerror(errno));
+      return;
+    }
+    if (port > 0) {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    add_connection(server, fd);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *socket_path = SERVER_SOCKET;
+  int port = 0;
+  int num_threads = SERVER_THREADS;
+  int exact = 0;
+  Server server;
+  server.nprobe = ANN_NPROBE;
+  server.rerank = ANN_RERANK;
+
+  int bad_args = 0;
+  for (int i = 1; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--nprobe") == 0 && i + 1 < argc) {
+      server.nprobe = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rerank") == 0 && i + 1 < argc) {
+      server.rerank = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--exact") == 0) {
+      exact = 1;
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args || num_threads <= 0 || server.nprobe <= 0 || port < 0) {
+    printf("Usage: %s [-s socket | --tcp port] [-t threads] [--nprobe N] "
+           "[--rerank R] [--exact]\n",
+           argv[0]);
+    return 1;
+  }
+
+  server.index_file = exact ? NULL : INDEX_FILE;
+  ModelStamps stamps = model_stamps(server.index_file);
+  ServingModel *serving = serving_model_load(server.index_file, &stamps);
+  if (!serving)
+    return 1;
+  server.current = serving;
+  printf("Model loaded: %d movies, %d factors, %s (%s scoring%s)\n",
+         serving->model->num_movies, serving->model->num_factors,
+         precision_name(serving->precision),
+         serving->index ? "indexed" : "exact",
+         serving->genres ? ", genre filters" : "");
+
+  int listen_fd = open_listener(socket_path, port);
+  if (listen_fd < 0) {
+    serving_model_free(serving);
+    return 1;
+  }
+
+  int wake_pipe[2];
+  server.epoll_fd = epoll_create1(0);
+  if (server.epoll_fd < 0 || pipe(wake_pipe) != 0) {
+    fprintf(stderr, "Error creating event loop: %s\n", strerror(errno));
+    return 1;
+  }
+  fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+  wake_fd = wake_pipe[1];
+  // Listener and wake pipe are told apart from connections by these tags.
+  static char listener_tag, wake_tag;
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = &listener_tag;
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+  event.data.ptr = &wake_tag;
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, wake_pipe[0], &event);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&server.queue, 0, sizeof(server.queue));
+  pthread_mutex_init(&server.queue.lock, NULL);
+  pthread_cond_init(&server.queue.not_empty, NULL);
+  pthread_cond_init(&server.queue.not_full, NULL);
+  server.connections = NULL;
+  pthread_mutex_init(&server.connections_lock, NULL);
+  server.num_threads = num_threads;
+  server.hazards = (HazardSlot *)calloc(num_threads, sizeof(HazardSlot));
+  pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+  Worker *workers = (Worker *)malloc(num_threads * sizeof(Worker));
+
+  // Threads inherit the blocked mask, so the signals reach the main thread.
+  sigset_t stop_signals, old_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+  for (int t = 0; t < num_threads; t++) {
+    workers[t].server = &server;
+    workers[t].id = t;
+    pthread_create(&threads[t], NULL, worker_main, &workers[t]);
+  }
+  pthread_t reloader;
+  pthread_create(&reloader, NULL, reload_main, &server);
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+  if (port > 0)
+    printf("Serving on 127.0.0.1:%d with %d threads\n", port, num_threads);
+  else
+    printf("Serving on %s with %d threads\n", socket_path, num_threads);
+  fflush(stdout);
+
+  struct epoll_event events[MAX_EVENTS];
+  while (!stop_requested) {
+    int n = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno != EINTR)
+        fprintf(stderr, "Error waiting for requests: %s\n", strerror(errno));
+      continue;
+    }
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == &listener_tag)
+        accept_connections(&server, listen_fd, port);
+      else if (events[i].data.ptr != &wake_tag)
+        queue_push(&server.queue, (Connection *)events[i].data.ptr);
+    }
+  }
+
+  // No worker ever blocks reading a client, so each finishes the request it
+  // is answering and then takes its NULL. Connections still open, idle or
+  // queued behind the sentinels, are closed once the workers are gone.
+  printf("Shutting down\n");
+  fflush(stdout);
+  close(listen_fd);
+  if (port == 0)
+    unlink(socket_path);
+  for (int t = 0; t < num_threads; t++)
+    queue_push(&server.queue, NULL);
+  for (int t = 0; t < num_threads; t++)
+    pthread_join(threads[t], NULL);
+  pthread_join(reloader, NULL);
+  while (server.connections)
+    close_connection(&server, server.connections);
+  close(server.epoll_fd);
+  close(wake_pipe[0]);
+  close(wake_pipe[1]);
+  free(threads);
+  free(workers);
+  free(server.hazards);
+  serving_model_free(server.current);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Checks that recommend_server serves more persistent clients than it has
+# workers, and that SIGTERM stops it promptly while idle clients are still
+# connected. Needs a trained model in the current directory.
+
+SOCKET="test_server.sock"
+WORKERS=2
+IDLE_CLIENTS=3
+ACTIVE_CLIENTS=6
+
+if [ ! -f "serving_model.bin" ] || [ ! -f "movie_mapping.bin" ]; then
+    echo "Error: model files not found"
+    echo "Please run './train.sh' first to train the model"
+    exit 1
+fi
+
+make recommend_server loadgen || exit 1
+
+SERVER_PID=""
+IDLE_PID=""
+cleanup() {
+    [ -n "$IDLE_PID" ] && kill "$IDLE_PID" 2>/dev/null
+    [ -n "$SERVER_PID" ] && kill -KILL "$SERVER_PID" 2>/dev/null
+    rm -f "$SOCKET"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+./recommend_server -s "$SOCKET" -t $WORKERS --exact &
+SERVER_PID=$!
+for i in $(seq 50); do
+    [ -S "$SOCKET" ] && break
+    sleep 0.1
+done
+[ -S "$SOCKET" ] || fail "server did not start"
+
+# Connections that never send a request. With one connection per worker
+# they would take every worker and starve the clients below.
+python3 - "$SOCKET" $IDLE_CLIENTS <<'EOF' &
+import socket, sys, time
+conns = []
+for _ in range(int(sys.argv[2])):
+    conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    conn.connect(sys.argv[1])
+    conns.append(conn)
+time.sleep(60)
+EOF
+IDLE_PID=$!
+sleep 0.5
+
+echo "$ACTIVE_CLIENTS active and $IDLE_CLIENTS idle clients on $WORKERS workers"
+timeout 30 ./loadgen -s "$SOCKET" -c $ACTIVE_CLIENTS -n 200 ||
+    fail "clients beyond the worker count were not served"
+
+kill -TERM "$SERVER_PID"
+for i in $(seq 30); do
+    kill -0 "$SERVER_PID" 2>/dev/null || break
+    sleep 0.1
+done
+kill -0 "$SERVER_PID" 2>/dev/null &&
+    fail "server still running 3 s after SIGTERM with idle clients connected"
+SERVER_PID=""
+
+echo "PASS"
@@ -0,0 +1,298 @@
+#include "title_index.h"
+#include "topk.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Base letters for U+00C0..U+017F. '*' marks the ligatures, which expand to
+// two letters, and ' ' marks the multiplication and division signs.
+static const char latin_fold[] =
+    "aaaaaa*ceeeeiiiidnooooo ouuuuy**aaaaaa*ceeeeiiiidnooooo ouuuuy*y"
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii**jjkkklllllll"
+    "lllnnnnnnnnnoooooo**rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+static int decode_utf8(const unsigned char *s, int *codepoint) {
+  if (s[0] < 0x80) {
+    *codepoint = s[0];
+    return 1;
+  }
+  if ((s[0] & 0xE0) == 0xC0 && (s[1] & 0xC0) == 0x80) {
+    *codepoint = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    return 2;
+  }
+  *codepoint = -1;
+  return 1;
+}
+
+static const char *fold_ligature(int codepoint) {
+  switch (codepoint) {
+  case 0xC6:
+  case 0xE6:
+    return "ae";
+  case 0xDF:
+    return "ss";
+  case 0xDE:
+  case 0xFE:
+    return "th";
+  case 0x132:
+  case 0x133:
+    return "ij";
+  case 0x152:
+  case 0x153:
+    return "oe";
+  default:
+    return "";
+  }
+}
+
+// Writes the normalized form of `in` into `out`, which must hold
+// 2 * strlen(in) + 1 bytes, and returns its length. Letters and digits are
+// kept, apostrophes are dropped so "schindler's" matches "schindlers", and
+// any other run of symbols becomes one space. Bytes outside Latin-1 and
+// Latin Extended-A are copied through unchanged.
+int normalize_title(const char *in, char *out) {
+  const unsigned char *s = (const unsigned char *)in;
+  int len = 0;
+  int pending_space = 0;
+  while (*s) {
+    int codepoint;
+    int step = decode_utf8(s, &codepoint);
+    char folded[3] = {0, 0, 0};
+    if (codepoint < 0) {
+      folded[0] = (char)*s;
+    } else if (codepoint < 0x80) {
+      if ((codepoint >= 'a' && codepoint <= 'z') ||
+          (codepoint >= '0' && codepoint <= '9'))
+        folded[0] = (char)codepoint;
+      else if (codepoint >= 'A' && codepoint <= 'Z')
+        folded[0] = (char)(codepoint - 'A' + 'a');
+      else if (codepoint == '\'')
+        folded[0] = 0;
+      else
+        pending_space = len > 0;
+    } else if (codepoint >= 0xC0 && codepoint <= 0x17F) {
+      char base = latin_fold[codepoint - 0xC0];
+      if (base == '*')
+        strcpy(folded, fold_ligature(codepoint));
+      else if (base == ' ')
+        pending_space = len > 0;
+      else
+        folded[0] = base;
+    } else if (codepoint >= 0x80 && codepoint < 0xC0) {
+      pending_space = len > 0;
+    } else {
+      memcpy(folded, s, step);
+    }
+
+    if (folded[0]) {
+      if (pending_space)
+        out[len++] = ' ';
+      pending_space = 0;
+      for (int i = 0; i < 3 && folded[i]; i++)
+        out[len++] = folded[i];
+    }
+    s += step;
+  }
+  out[len] = '\0';
+  return len;
+}
+
+// Trigrams of " text ", so word starts and ends get their own keys and short
+// queries still produce at least one trigram. Keys are sorted and unique.
+static int extract_trigrams(const char *text, int len, int *keys) {
+  if (len == 0)
+    return 0;
+  for (int i = 0; i < len; i++) {
+    unsigned char a = i > 0 ? (unsigned char)text[i - 1] : ' ';
+    unsigned char b = (unsigned char)text[i];
+    unsigned char c = i + 1 < len ? (unsigned char)text[i + 1] : ' ';
+    keys[i] = (a << 16) | (b << 8) | c;
+  }
+  qsort(keys, len, sizeof(int), compare_ints);
+  int unique = 1;
+  for (int i = 1; i < len; i++) {
+    if (keys[i] != keys[unique - 1])
+      keys[unique++] = keys[i];
+  }
+  return unique;
+}
+
+typedef struct {
+  int key;
+  int movie;
+} TrigramEntry;
+
+static int compare_entries(const void *a, const void *b) {
+  const TrigramEntry *x = (const TrigramEntry *)a;
+  const TrigramEntry *y = (const TrigramEntry *)b;
+  if (x->key != y->key)
+    return (x->key > y->key) - (x->key < y->key);
+  return (x->movie > y->movie) - (x->movie < y->movie);
+}
+
+TitleIndex *title_index_build(const Catalog *catalog,
+                              const int *rating_counts) {
+  int num_movies = catalog->num_movies;
+  TitleIndex *index = (TitleIndex *)calloc(1, sizeof(TitleIndex));
+  index->num_movies = num_movies;
+  index->normalized_offsets = (int *)malloc((num_movies + 1) * sizeof(int));
+  index->title_trigrams = (int *)calloc(num_movies, sizeof(int));
+  index->popularity = (float *)calloc(num_movies, sizeof(float));
+  index->shared = (int *)calloc(num_movies, sizeof(int));
+  index->touched = (int *)malloc(num_movies * sizeof(int));
+
+  size_t total_len = 0;
+  for (int i = 0; i < num_movies; i++) {
+    const char *title = catalog_title(catalog, i);
+    if (title)
+      total_len += 2 * strlen(title) + 1;
+  }
+  index->normalized = (char *)malloc(total_len + 1);
+
+  size_t entries_cap = total_len + 1;
+  TrigramEntry *entries =
+      (TrigramEntry *)malloc(entries_cap * sizeof(TrigramEntry));
+  int *keys = (int *)malloc((total_len + 2) * sizeof(int));
+  size_t num_entries = 0;
+  int offset = 0;
+  for (int i = 0; i < num_movies; i++) {
+    index->normalized_offsets[i] = offset;
+    const char *title = catalog_title(catalog, i);
+    if (!title) {
+      index->normalized[offset++] = '\0';
+      continue;
+    }
+    char *out = index->normalized + offset;
+    int len = normalize_title(title, out);
+    offset += len + 1;
+    int n = extract_trigrams(out, len, keys);
+    index->title_trigrams[i] = n;
+    for (int t = 0; t < n; t++) {
+      entries[num_entries].key = keys[t];
+      entries[num_entries].movie = i;
+      num_entries++;
+    }
+  }
+  index->normalized_offsets[num_movies] = offset;
+  qsort(entries, num_entries, sizeof(TrigramEntry), compare_entries);
+
+  index->trigram_keys = (int *)malloc((num_entries + 1) * sizeof(int));
+  index->posting_offsets = (int *)malloc((num_entries + 2) * sizeof(int));
+  index->postings = (int *)malloc((num_entries + 1) * sizeof(int));
+  int num_trigrams = 0;
+  for (size_t e = 0; e < num_entries; e++) {
+    if (e == 0 || entries[e].key != entries[e - 1].key) {
+      index->trigram_keys[num_trigrams] = entries[e].key;
+      index->posting_offsets[num_trigrams++] = (int)e;
+    }
+    index->postings[e] = entries[e].movie;
+  }
+  index->posting_offsets[num_trigrams] = (int)num_entries;
+  index->num_trigrams = num_trigrams;
+  free(entries);
+  free(keys);
+
+  if (rating_counts) {
+    int max_count = 0;
+    for (int i = 0; i < num_movies; i++) {
+      if (rating_counts[i] > max_count)
+        max_count = rating_counts[i];
+    }
+    for (int i = 0; i < num_movies && max_count > 0; i++) {
+      index->popularity[i] =
+          (float)(log1p(rating_counts[i]) / log1p(max_count));
+    }
+  }
+  return index;
+}
+
+void title_index_free(TitleIndex *index) {
+  if (index) {
+    free(index->trigram_keys);
+    free(index->posting_offsets);
+    free(index->postings);
+    free(index->normalized);
+    free(index->normalized_offsets);
+    free(index->title_trigrams);
+    free(index->popularity);
+    free(index->shared);
+    free(index->touched);
+    free(index);
+  }
+}
+
+static int find_trigram(const TitleIndex *index, int key) {
+  int lo = 0, hi = index->num_trigrams - 1;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (index->trigram_keys[mid] == key)
+      return mid;
+    if (index->trigram_keys[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return -1;
+}
+
+// Only titles that share a trigram with the query are visited. A title that
+// contains the normalized query ranks above every fuzzy match. Fuzzy matches
+// must contain at least TITLE_MIN_COVERAGE of the query's trigrams. Within
+// each group, titles are ordered by query coverage, then Jaccard similarity
+// (which favours shorter titles), plus a popularity bonus. Uses the index's
+// scratch arrays, so it is not reentrant.
+int title_index_search(TitleIndex *index, const char *query, int max_results,
+                       int *results) {
+  char *normalized = (char *)malloc(2 * strlen(query) + 1);
+  int len = normalize_title(query, normalized);
+  int *keys = (int *)malloc((len + 2) * sizeof(int));
+  int num_keys = extract_trigrams(normalized, len, keys);
+  if (num_keys == 0 || max_results <= 0) {
+    free(normalized);
+    free(keys);
+    return 0;
+  }
+
+  int num_touched = 0;
+  for (int k = 0; k < num_keys; k++) {
+    int t = find_trigram(index, keys[k]);
+    if (t < 0)
+      continue;
+    for (int p = index->posting_offsets[t]; p < index->posting_offsets[t + 1];
+         p++) {
+      int movie = index->postings[p];
+      if (index->shared[movie]++ == 0)
+        index->touched[num_touched++] = movie;
+    }
+  }
+
+  Candidate *items = (Candidate *)malloc(max_results * sizeof(Candidate));
+  TopK topk;
+  topk_init(&topk, items, max_results);
+  for (int i = 0; i < num_touched; i++) {
+    int movie = index->touched[i];
+    int shared = index->shared[movie];
+    index->shared[movie] = 0;
+
+    float coverage = (float)shared / num_keys;
+    float jaccard =
+        (float)shared / (num_keys + index->title_trigrams[movie] - shared);
+    const char *title = index->normalized + index->normalized_offsets[movie];
+    int substring = strstr(title, normalized) != NULL;
+    if (!substring && coverage < TITLE_MIN_COVERAGE)
+      continue;
+    float score = coverage + 0.5f * jaccard +
+                  TITLE_POPULARITY_WEIGHT * index->popularity[movie] +
+                  (substring ? 2.0f : 0.0f);
+    topk_push(&topk, score, movie);
+  }
+  topk_sort(&topk);
+  for (int i = 0; i < topk.size; i++)
+    results[i] = items[i].id;
+
+  int num_results = topk.size;
+  free(items);
+  free(normalized);
+  free(keys);
+  return num_results;
+}
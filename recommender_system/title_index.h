@@ -0,0 +1,34 @@
+#ifndef TITLE_INDEX_H
+#define TITLE_INDEX_H
+
+#include "catalog.h"
+
+#define TITLE_MAX_RESULTS 20
+#define TITLE_MIN_COVERAGE 0.5f
+#define TITLE_POPULARITY_WEIGHT 0.25f
+
+// Trigram index over normalized titles: lowercase ASCII, accents folded to
+// their base letter, punctuation collapsed to single spaces. Posting lists
+// are stored CSR-style, keyed by the three bytes of the trigram.
+typedef struct {
+  int num_movies;
+  int num_trigrams;
+  int *trigram_keys;
+  int *posting_offsets;
+  int *postings;
+  char *normalized;
+  int *normalized_offsets;
+  int *title_trigrams;
+  float *popularity;
+  int *shared;
+  int *touched;
+} TitleIndex;
+
+TitleIndex *title_index_build(const Catalog *catalog,
+                              const int *rating_counts);
+void title_index_free(TitleIndex *index);
+int title_index_search(TitleIndex *index, const char *query, int max_results,
+                       int *results);
+int normalize_title(const char *in, char *out);
+
+#endif
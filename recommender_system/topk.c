@@ -0,0 +1,48 @@
+#include "topk.h"
+#include <stdlib.h>
+
+void topk_init(TopK *topk, Candidate *storage, int k) {
+  topk->items = storage;
+  topk->size = 0;
+  topk->capacity = k;
+}
+
+void topk_replace_root(TopK *topk, float score, int id) {
+  Candidate *items = topk->items;
+  int n = topk->size;
+  int i = 0;
+  while (1) {
+    int child = 2 * i + 1;
+    if (child >= n)
+      break;
+    if (child + 1 < n &&
+        candidate_better(items[child].score, items[child].id,
+                         items[child + 1].score, items[child + 1].id))
+      child++;
+    if (!candidate_better(score, id, items[child].score, items[child].id))
+      break;
+    items[i] = items[child];
+    i = child;
+  }
+  items[i].score = score;
+  items[i].id = id;
+}
+
+int compare_candidates(const void *a, const void *b) {
+  const Candidate *ca = (const Candidate *)a;
+  const Candidate *cb = (const Candidate *)b;
+  if (candidate_better(ca->score, ca->id, cb->score, cb->id))
+    return -1;
+  if (candidate_better(cb->score, cb->id, ca->score, ca->id))
+    return 1;
+  return 0;
+}
+
+int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+void topk_sort(TopK *topk) {
+  qsort(topk->items, topk->size, sizeof(Candidate), compare_candidates);
+}
@@ -0,0 +1,50 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+typedef struct {
+  float score;
+  int id;
+} Candidate;
+
+// Bounded min-heap holding the best k candidates seen so far. The root is
+// the weakest kept candidate, so most scores are rejected by one compare.
+typedef struct {
+  Candidate *items;
+  int size;
+  int capacity;
+} TopK;
+
+void topk_init(TopK *topk, Candidate *storage, int k);
+void topk_replace_root(TopK *topk, float score, int id);
+void topk_sort(TopK *topk);
+int compare_candidates(const void *a, const void *b);
+// Ascending ints, for qsort and bsearch over sorted exclusion lists.
+int compare_ints(const void *a, const void *b);
+
+// Higher scores win; ties go to the lower id so results are deterministic.
+static inline int candidate_better(float score_a, int id_a, float score_b,
+                                   int id_b) {
+  return score_a > score_b || (score_a == score_b && id_a < id_b);
+}
+
+static inline void topk_push(TopK *topk, float score, int id) {
+  if (topk->size < topk->capacity) {
+    int i = topk->size++;
+    while (i > 0) {
+      int parent = (i - 1) / 2;
+      if (!candidate_better(topk->items[parent].score, topk->items[parent].id,
+                            score, id))
+        break;
+      topk->items[i] = topk->items[parent];
+      i = parent;
+    }
+    topk->items[i].score = score;
+    topk->items[i].id = id;
+  } else if (topk->capacity > 0 &&
+             candidate_better(score, id, topk->items[0].score,
+                              topk->items[0].id)) {
+    topk_replace_root(topk, score, id);
+  }
+}
+
+#endif
@@ -24,8 +24,53 @@ static float predict_rating(Model *model, int user_id, int movie_id) {
   return prediction;
 }
 
-void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
-                          int rank, int size) {
+// Each rank's vote for a row is the number of SGD updates it applied to that
+// row since the last sync. The local shard is fixed across epochs, so that is
+// the row's occurrence count in the shard times the epochs since the sync, and
+// the epoch factor cancels out of the weighted mean. Rows nobody trains fall
+// back to a plain mean so all ranks still agree on them.
+static void compute_sync_weights(const Dataset *train_data, int local_start,
+                                 int local_end, int num_rows, int use_user,
+                                 int size, float *weight, float *inv_total) {
+  int *counts = (int *)calloc(num_rows, sizeof(int));
+  for (int idx = local_start; idx < local_end; idx++) {
+    int row = use_user ? train_data->ratings[idx].user_id
+                       : train_data->ratings[idx].movie_id;
+    counts[row]++;
+  }
+
+  int *totals = (int *)malloc(num_rows * sizeof(int));
+  MPI_Allreduce(counts, totals, num_rows, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+  for (int i = 0; i < num_rows; i++) {
+    if (totals[i] > 0) {
+      weight[i] = (float)counts[i];
+      inv_total[i] = 1.0f / totals[i];
+    } else {
+      weight[i] = 1.0f;
+      inv_total[i] = 1.0f / size;
+    }
+  }
+
+  free(counts);
+  free(totals);
+}
+
+static void scale_rows(float *features, float *bias, const float *scale,
+                       int num_rows, int num_factors) {
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < num_rows; i++) {
+    float *row = features + (size_t)i * num_factors;
+    bias[i] *= scale[i];
+    for (int k = 0; k < num_factors; k++) {
+      row[k] *= scale[i];
+    }
+  }
+}
+
+void train_model_parallel(Model *model, Dataset *train_data, int start_iter,
+                          int num_iterations, int rank, int size,
+                          Checkpointer *checkpointer) {
   int local_start = (train_data->num_ratings / size) * rank;
   int local_end = (rank == size - 1)
                       ? train_data->num_ratings
@@ -41,17 +86,19 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
     printf("Using synchronization interval: %d iterations\n", sync_interval);
   }
 
-  int user_feature_size = model->num_users * model->num_factors;
-  int movie_feature_size = model->num_movies * model->num_factors;
-  float *flat_user_features =
-      (float *)malloc(user_feature_size * sizeof(float));
-  float *flat_movie_features =
-      (float *)malloc(movie_feature_size * sizeof(float));
+  float *user_weight = (float *)malloc(model->num_users * sizeof(float));
+  float *user_inv_total = (float *)malloc(model->num_users * sizeof(float));
+  float *movie_weight = (float *)malloc(model->num_movies * sizeof(float));
+  float *movie_inv_total = (float *)malloc(model->num_movies * sizeof(float));
+  compute_sync_weights(train_data, local_start, local_end, model->num_users, 1,
+                       size, user_weight, user_inv_total);
+  compute_sync_weights(train_data, local_start, local_end, model->num_movies,
+                       0, size, movie_weight, movie_inv_total);
 
   double comm_time = 0.0, comp_time = 0.0;
   int sync_count = 0;
 
-  for (int iter = 0; iter < num_iterations; iter++) {
+  for (int iter = start_iter; iter < num_iterations; iter++) {
     double iter_start = MPI_Wtime();
 
     for (int idx = local_start; idx < local_end; idx++) {
@@ -89,57 +136,36 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
       double comm_start = MPI_Wtime();
       sync_count++;
 
-      for (int i = 0; i < model->num_users; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          flat_user_features[base_idx + k] = model->user_features[i][k];
-        }
-      }
-
-      for (int i = 0; i < model->num_movies; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          flat_movie_features[base_idx + k] = model->movie_features[i][k];
-        }
-      }
+      // The factor blocks are contiguous, so they are weighted, reduced and
+      // rescaled in place without a staging copy.
+      scale_rows(model->user_feature_data, model->user_bias, user_weight,
+                 model->num_users, model->num_factors);
+      scale_rows(model->movie_feature_data, model->movie_bias, movie_weight,
+                 model->num_movies, model->num_factors);
 
       MPI_Allreduce(MPI_IN_PLACE, model->user_bias, model->num_users, MPI_FLOAT,
                     MPI_SUM, MPI_COMM_WORLD);
       MPI_Allreduce(MPI_IN_PLACE, model->movie_bias, model->num_movies,
                     MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
 
-      MPI_Allreduce(MPI_IN_PLACE, flat_user_features, user_feature_size,
-                    MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-
-      MPI_Allreduce(MPI_IN_PLACE, flat_movie_features, movie_feature_size,
-                    MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-
-      float scale = 1.0f / size;
+      MPI_Allreduce(MPI_IN_PLACE, model->user_feature_data,
+                    model->num_users * model->num_factors, MPI_FLOAT, MPI_SUM,
+                    MPI_COMM_WORLD);
+      MPI_Allreduce(MPI_IN_PLACE, model->movie_feature_data,
+                    model->num_movies * model->num_factors, MPI_FLOAT, MPI_SUM,
+                    MPI_COMM_WORLD);
 
-      for (int i = 0; i < model->num_users; i++) {
-        model->user_bias[i] *= scale;
-      }
-      for (int i = 0; i < model->num_movies; i++) {
-        model->movie_bias[i] *= scale;
-      }
+      scale_rows(model->user_feature_data, model->user_bias, user_inv_total,
+                 model->num_users, model->num_factors);
+      scale_rows(model->movie_feature_data, model->movie_bias, movie_inv_total,
+                 model->num_movies, model->num_factors);
 
-      for (int i = 0; i < model->num_users; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          model->user_features[i][k] = flat_user_features[base_idx + k] * scale;
-        }
-      }
+      comm_time += MPI_Wtime() - comm_start;
 
-      for (int i = 0; i < model->num_movies; i++) {
-        int base_idx = i * model->num_factors;
-        for (int k = 0; k < model->num_factors; k++) {
-          model->movie_features[i][k] =
-              flat_movie_features[base_idx + k] * scale;
-        }
+      if (checkpointer) {
+        checkpointer_submit(checkpointer, model, iter + 1);
       }
 
-      comm_time += MPI_Wtime() - comm_start;
-
       if (rank == 0) {
         printf("Iteration %d completed (synchronized)\n", iter + 1);
       }
@@ -148,7 +174,9 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
     }
   }
 
-  if (rank == 0) {
+  // Resuming from a checkpoint of the final epoch runs no iterations, which
+  // leaves nothing to break down.
+  if (rank == 0 && start_iter < num_iterations) {
     printf("\nTraining Performance Breakdown\n");
     printf("Computation time: %.2f seconds (%.1f%%)\n", comp_time,
            comp_time / (comp_time + comm_time) * 100);
@@ -156,41 +184,25 @@ void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
            comm_time / (comp_time + comm_time) * 100);
     printf("Total synchronizations: %d\n", sync_count);
     printf("Communication reduction: %.1f%%\n",
-           (1.0 - (float)sync_count / num_iterations) * 100);
+           (1.0 - (float)sync_count / (num_iterations - start_iter)) * 100);
   }
 
-  free(flat_user_features);
-  free(flat_movie_features);
+  free(user_weight);
+  free(user_inv_total);
+  free(movie_weight);
+  free(movie_inv_total);
 }
 
-float compute_rmse(Model *model, Dataset *test_data, int rank, int size) {
-  int local_start = (test_data->num_ratings / size) * rank;
-  int local_end = (rank == size - 1)
-                      ? test_data->num_ratings
-                      : (test_data->num_ratings / size) * (rank + 1);
-
-  float local_squared_error = 0.0;
-
-  for (int idx = local_start; idx < local_end; idx++) {
-    int user_id = test_data->ratings[idx].user_id;
-    int movie_id = test_data->ratings[idx].movie_id;
-    float actual_rating = test_data->ratings[idx].rating;
-
-    float predicted_rating = predict_rating(model, user_id, movie_id);
-    float error = actual_rating - predicted_rating;
-    local_squared_error += error * error;
-  }
-
-  float total_squared_error = 0.0;
-  MPI_Reduce(&local_squared_error, &total_squared_error, 1, MPI_FLOAT, MPI_SUM,
-             0, MPI_COMM_WORLD);
-
-  float rmse = 0.0;
-  if (rank == 0) {
-    rmse = sqrt(total_squared_error / test_data->num_ratings);
-  }
-
-  MPI_Bcast(&rmse, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
-
-  return rmse;
-}
\ No newline at end of file
+void broadcast_model(Model *model, int root) {
+  MPI_Bcast(&model->global_mean, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
+  MPI_Bcast(&model->learning_rate, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
+  MPI_Bcast(&model->regularization, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
+  MPI_Bcast(model->user_bias, model->num_users, MPI_FLOAT, root,
+            MPI_COMM_WORLD);
+  MPI_Bcast(model->movie_bias, model->num_movies, MPI_FLOAT, root,
+            MPI_COMM_WORLD);
+  MPI_Bcast(model->user_feature_data, model->num_users * model->num_factors,
+            MPI_FLOAT, root, MPI_COMM_WORLD);
+  MPI_Bcast(model->movie_feature_data, model->num_movies * model->num_factors,
+            MPI_FLOAT, root, MPI_COMM_WORLD);
+}
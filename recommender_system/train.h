@@ -1,10 +1,12 @@
 #ifndef TRAIN_H
 #define TRAIN_H
 
+#include "checkpoint.h"
 #include "data_structures.h"
 
-void train_model_parallel(Model *model, Dataset *train_data, int num_iterations,
-                          int rank, int size);
-float compute_rmse(Model *model, Dataset *test_data, int rank, int size);
+void train_model_parallel(Model *model, Dataset *train_data, int start_iter,
+                          int num_iterations, int rank, int size,
+                          Checkpointer *checkpointer);
+void broadcast_model(Model *model, int root);
 
 #endif
@@ -2,6 +2,21 @@
 
 DATA_FILE="../data/ratings.csv"
 NUM_PROCS=${1:-4}
+CHECKPOINT_FILE="checkpoint.bin"
+RESUME_ARGS=""
+SERVING_ARGS=""
+
+if [ -n "$SERVING_PRECISION" ]; then
+    SERVING_ARGS="--serving $SERVING_PRECISION"
+fi
+
+if [ "$2" == "--resume" ]; then
+    if [ ! -f "$CHECKPOINT_FILE" ]; then
+        echo "Error: $CHECKPOINT_FILE not found, nothing to resume"
+        exit 1
+    fi
+    RESUME_ARGS="--resume $CHECKPOINT_FILE"
+fi
 
 if [ ! -f "$DATA_FILE" ]; then
     echo "Error: $DATA_FILE not found"
@@ -10,7 +25,7 @@ if [ ! -f "$DATA_FILE" ]; then
 fi
 
 echo "Cleaning old files"
-rm -f model.bin movie_mapping.bin train_save *.o
+rm -f model.bin movie_mapping.bin serving_model.bin train_save *.o
 
 echo "Building train_save"
 make train_save
@@ -23,21 +38,23 @@ fi
 
 echo "Training model with $NUM_PROCS processes"
 echo "This may take a few minutes"
-mpirun -np $NUM_PROCS ./train_save "$DATA_FILE"
+mpirun -np $NUM_PROCS ./train_save "$DATA_FILE" $RESUME_ARGS $SERVING_ARGS
 
 if [ $? -ne 0 ]; then
     echo "Error: Training failed with exit code $?"
     exit 1
 fi
 
-if [ -f "model.bin" ] && [ -f "movie_mapping.bin" ]; then
+if [ -f "model.bin" ] && [ -f "movie_mapping.bin" ] && [ -f "serving_model.bin" ]; then
     echo ""
     echo "Training complete!"
     echo "Model saved to: model.bin"
     echo "Mapping saved to: movie_mapping.bin"
+    echo "Serving model saved to: serving_model.bin"
     echo ""
     echo "Model file size: $(ls -lh model.bin | awk '{print $5}')"
     echo "Mapping file size: $(ls -lh movie_mapping.bin | awk '{print $5}')"
+    echo "Serving model size: $(ls -lh serving_model.bin | awk '{print $5}')"
     echo ""
     echo "You can now run: ./run.sh"
 else
@@ -1,11 +1,16 @@
+#include "checkpoint.h"
 #include "config.h"
 #include "data_loader.h"
 #include "data_structures.h"
+#include "metrics.h"
 #include "model.h"
+#include "model_io.h"
+#include "popularity.h"
 #include "train.h"
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char **argv) {
   int rank, size;
@@ -15,9 +20,23 @@ int main(int argc, char **argv) {
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-  if (argc < 2) {
+  const char *resume_file = NULL;
+  Precision serving_precision = PRECISION_FP32;
+  int bad_args = argc < 2;
+  for (int i = 2; i < argc && !bad_args; i++) {
+    if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+      resume_file = argv[++i];
+    } else if (strcmp(argv[i], "--serving") == 0 && i + 1 < argc) {
+      bad_args = !parse_precision(argv[++i], &serving_precision);
+    } else {
+      bad_args = 1;
+    }
+  }
+  if (bad_args) {
     if (rank == 0) {
-      printf("Usage: %s <ratings_file.csv>\n", argv[0]);
+      printf("Usage: %s <ratings_file.csv> [--resume <checkpoint>] "
+             "[--serving fp32|fp16|int8]\n",
+             argv[0]);
     }
     MPI_Finalize();
     return 1;
@@ -55,39 +74,103 @@ int main(int argc, char **argv) {
 
   Model *model = create_model(dataset->num_users, dataset->num_movies,
                               NUM_FACTORS, LEARNING_RATE, REGULARIZATION);
+  if (!model) {
+    fprintf(stderr, "Error: out of memory for a %d x %d x %d model\n",
+            dataset->num_users, dataset->num_movies, NUM_FACTORS);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
   compute_global_mean(model, train_data);
   if (rank == 0) {
     printf("Global mean rating: %.4f\n", model->global_mean);
   }
 
-  initialize_model(model, rank);
+  initialize_model(model, RANDOM_SEED);
+
+  int start_iter = 0;
+  if (resume_file) {
+    int checkpoint_ranks = size;
+    if (rank == 0) {
+      if (!load_checkpoint(resume_file, model, &start_iter,
+                           &checkpoint_ranks)) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      printf("Resuming from %s at iteration %d\n", resume_file, start_iter);
+      if (checkpoint_ranks != size) {
+        printf("Warning: checkpoint was written by %d processes; results will "
+               "differ from an uninterrupted run\n",
+               checkpoint_ranks);
+      }
+    }
+    MPI_Bcast(&start_iter, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    broadcast_model(model, 0);
+  }
 
+  Checkpointer *checkpointer = NULL;
   if (rank == 0) {
+    checkpointer = checkpointer_create(CHECKPOINT_FILE, size);
     printf("Training model with %d factors for %d iterations\n", NUM_FACTORS,
            NUM_ITERATIONS);
   }
 
-  train_model_parallel(model, train_data, NUM_ITERATIONS, rank, size);
+  train_model_parallel(model, train_data, start_iter, NUM_ITERATIONS, rank,
+                       size, checkpointer);
+  checkpointer_destroy(checkpointer);
 
   if (rank == 0) {
     printf("Computing RMSE on test set\n");
   }
-  float rmse = compute_rmse(model, test_data, rank, size);
+  ErrorMetrics errors;
+  evaluate_errors(model, test_data, rank, size, &errors);
 
   if (rank == 0) {
-    printf("Test RMSE: %.4f\n", rmse);
-
+    printf("Test RMSE: %.4f, MAE: %.4f\n", errors.rmse, errors.mae);
     printf("Saving model\n");
-    save_model("model.bin", model);
+  }
+
+  // Both files are written under temporary names and renamed into place,
+  // mapping first, so a running recommend_server never sees a partial model.
+  double save_start = MPI_Wtime();
+  if (!save_model_parallel(MODEL_FILE ".tmp", model, rank, size)) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  double save_time = MPI_Wtime() - save_start;
 
-    FILE *f = fopen("movie_mapping.bin", "wb");
-    if (f) {
-      fwrite(&dataset->num_movies, sizeof(int), 1, f);
-      fwrite(mapper->reverse_movie_map, sizeof(int), dataset->num_movies, f);
-      fclose(f);
+  if (rank == 0) {
+    printf("Model written in %.2f seconds\n", save_time);
+
+    // Popularity tables for title search, cold-start requests and the
+    // minimum-support filter. Only training ratings count, so held-out test
+    // ratings never leak into the served rankings.
+    if (!save_movie_stats(MOVIE_STATS_FILE ".tmp", train_data,
+                          POPULARITY_PRIOR) ||
+        rename(MOVIE_STATS_FILE ".tmp", MOVIE_STATS_FILE) != 0)
+      fprintf(stderr, "Error publishing %s\n", MOVIE_STATS_FILE);
+
+    FILE *f = fopen(MAPPING_FILE ".tmp", "wb");
+    int ok = f &&
+             fwrite(&dataset->num_movies, sizeof(int), 1, f) == 1 &&
+             fwrite(mapper->reverse_movie_map, sizeof(int),
+                    dataset->num_movies, f) == (size_t)dataset->num_movies;
+    if (f && fclose(f) != 0)
+      ok = 0;
+    if (!ok || rename(MAPPING_FILE ".tmp", MAPPING_FILE) != 0 ||
+        rename(MODEL_FILE ".tmp", MODEL_FILE) != 0) {
+      fprintf(stderr, "Error publishing %s and %s\n", MODEL_FILE,
+              MAPPING_FILE);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    printf("Model saved to %s and %s\n", MODEL_FILE, MAPPING_FILE);
+
+    // All ranks hold the full model after training, so rank 0 alone writes
+    // the movie-only artifact that recommend loads.
+    if (!save_serving_model(SERVING_FILE ".tmp", model, serving_precision) ||
+        rename(SERVING_FILE ".tmp", SERVING_FILE) != 0) {
+      fprintf(stderr, "Error publishing %s\n", SERVING_FILE);
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    printf("Model saved to model.bin and movie_mapping.bin\n");
+    printf("Serving model saved to %s (%s)\n", SERVING_FILE,
+           precision_name(serving_precision));
   }
 
   end_time = MPI_Wtime();
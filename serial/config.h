@@ -6,6 +6,7 @@
 #define REGULARIZATION 0.01
 #define NUM_ITERATIONS 50
 #define TRAIN_TEST_SPLIT 0.8
+#define RANDOM_SEED 42ULL
 #define MAX_LINE_LENGTH 256
 
 #endif
\ No newline at end of file
@@ -31,7 +31,7 @@ int main(int argc, char **argv) {
   compute_global_mean(model, train_data);
   printf("Global mean rating: %.4f\n", model->global_mean);
 
-  initialize_model(model);
+  initialize_model(model, RANDOM_SEED);
 
   printf("Training model with %d factors for %d iterations\n", NUM_FACTORS,
          NUM_ITERATIONS);
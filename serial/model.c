@@ -1,6 +1,6 @@
 #include "model.h"
+#include <stdint.h>
 #include <stdlib.h>
-#include <time.h>
 
 Model *create_model(int num_users, int num_movies, int num_factors,
                     float learning_rate, float regularization) {
@@ -47,18 +47,37 @@ void free_model(Model *model) {
   }
 }
 
-void initialize_model(Model *model) {
-  srand(time(NULL));
+// splitmix64 finalizer used as a counter-based generator: every parameter is
+// a pure function of (seed, matrix, row, factor), so the initial model is
+// identical to the parallel builds' initialization for the same seed.
+static inline uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static inline float init_value(uint64_t key, uint64_t counter) {
+  uint64_t bits = splitmix64(key + counter);
+  return (float)(bits >> 40) * (1.0f / 16777216.0f) * 0.1f;
+}
+
+void initialize_model(Model *model, unsigned long long seed) {
+  uint64_t user_key = splitmix64(seed);
+  uint64_t movie_key = splitmix64(user_key);
+  int num_factors = model->num_factors;
 
   for (int i = 0; i < model->num_users; i++) {
-    for (int j = 0; j < model->num_factors; j++) {
-      model->user_features[i][j] = ((float)rand() / RAND_MAX) * 0.1;
+    for (int j = 0; j < num_factors; j++) {
+      model->user_features[i][j] =
+          init_value(user_key, (uint64_t)i * num_factors + j);
     }
   }
 
   for (int i = 0; i < model->num_movies; i++) {
-    for (int j = 0; j < model->num_factors; j++) {
-      model->movie_features[i][j] = ((float)rand() / RAND_MAX) * 0.1;
+    for (int j = 0; j < num_factors; j++) {
+      model->movie_features[i][j] =
+          init_value(movie_key, (uint64_t)i * num_factors + j);
     }
   }
 }